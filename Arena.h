@@ -4,234 +4,4271 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 #define KB *1024
 #define MB *1024 * 1024
 #define GB *1024 * 1024 * 1024
 
-// #define ARENA_IMPLEMENTATION
-// #define ARENA_CPP
+// #define ARENA_IMPLEMENTATION
+// #define ARENA_CPP
+// #define ARENA_TRACE
+// #define ARENA_DEBUG
+// #define ARENA_VALGRIND
+// #define ARENA_REGION_CACHE
+// #define ARENA_SCRUB_THREAD
+
+#ifdef __cplusplus
+#define ARENA_THREAD_LOCAL thread_local
+#else
+#define ARENA_THREAD_LOCAL _Thread_local
+#endif
+
+#define ALIGN_SIZE(size_bytes) (((size_bytes) + sizeof(uintptr_t) - 1) / sizeof(uintptr_t))
+
+// ARENA_DEBUG puts a poisoned redzone in front of every allocation and poisons
+// and pattern-fills memory given back by reset or pop, so ASan (detected
+// automatically) and Valgrind (with ARENA_VALGRIND) can see arena misuse.
+// Release builds compile all of it away.
+#ifdef ARENA_DEBUG
+
+#ifndef ARENA_REDZONE_BYTES
+#define ARENA_REDZONE_BYTES 16
+#endif
+#ifndef ARENA_RESET_PATTERN
+#define ARENA_RESET_PATTERN 0xDD
+#endif
+#define ARENA_REDZONE_WORDS ALIGN_SIZE(ARENA_REDZONE_BYTES)
+
+#if defined(__SANITIZE_ADDRESS__)
+#define ARENA_ASAN
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define ARENA_ASAN
+#endif
+#endif
+
+#ifdef ARENA_ASAN
+#include <sanitizer/asan_interface.h>
+#define ARENA_ASAN_POISON(addr, size) ASAN_POISON_MEMORY_REGION(addr, size)
+#define ARENA_ASAN_UNPOISON(addr, size) ASAN_UNPOISON_MEMORY_REGION(addr, size)
+#else
+#define ARENA_ASAN_POISON(addr, size) ((void)(addr), (void)(size))
+#define ARENA_ASAN_UNPOISON(addr, size) ((void)(addr), (void)(size))
+#endif
+
+#ifdef ARENA_VALGRIND
+#include <valgrind/memcheck.h>
+#define ARENA_VALGRIND_NOACCESS(addr, size) VALGRIND_MAKE_MEM_NOACCESS(addr, size)
+#define ARENA_VALGRIND_UNDEFINED(addr, size) VALGRIND_MAKE_MEM_UNDEFINED(addr, size)
+#else
+#define ARENA_VALGRIND_NOACCESS(addr, size) ((void)(addr), (void)(size))
+#define ARENA_VALGRIND_UNDEFINED(addr, size) ((void)(addr), (void)(size))
+#endif
+
+#define ARENA_POISON(addr, size)             \
+    do {                                     \
+        ARENA_ASAN_POISON(addr, size);       \
+        ARENA_VALGRIND_NOACCESS(addr, size); \
+    } while (0)
+#define ARENA_UNPOISON(addr, size)            \
+    do {                                      \
+        ARENA_ASAN_UNPOISON(addr, size);      \
+        ARENA_VALGRIND_UNDEFINED(addr, size); \
+    } while (0)
+
+#else
+
+#define ARENA_REDZONE_WORDS 0
+#define ARENA_POISON(addr, size)
+#define ARENA_UNPOISON(addr, size)
+
+#endif // ARENA_DEBUG
+
+// Where a region's memory came from, and so how region_free gives it back.
+enum {
+    REGION_MALLOC = 0,
+    REGION_MAPPED = 1 << 0, // mmap'd, released with munmap
+    REGION_SHARED = 1 << 1, // Inside a shared segment, unmapped with it
+    REGION_MEMFD = 1 << 2, // Shared mapping of its own memfd, which arena_fork maps privately
+    REGION_EXTERNAL = 1 << 3, // Owned by someone else (a caller's buffer, the arena header), never freed
+    REGION_RESERVED = 1 << 4, // Carved from its arena's reservation, unmapped with it
+    REGION_HEADER_BLOCK = 1 << 5, // Follows a merged arena's header in one malloc block, freed from there
+};
+
+typedef struct Region {
+    uint32_t data_count;
+    uint32_t capacity;
+    struct Region* next;
+    uint32_t flags;
+    int32_t fd; // Backing file of REGION_MEMFD regions, -1 otherwise
+    uint32_t zero_mark; // Words past both this and data_count are known to be zero
+    struct Arena* arena; // Arena the region serves, kept in ARENA_PAGE_MAP builds
+    uintptr_t data[];
+} Region;
+
+// How a new region is sized once the current one is exhausted.
+typedef enum ArenaGrowth {
+    ARENA_GROWTH_FIXED, // Same capacity as the region before it (default)
+    ARENA_GROWTH_DOUBLE, // Twice the capacity of the region before it
+    ARENA_GROWTH_NONE, // Never add a region, keeping the arena one contiguous block
+} ArenaGrowth;
+
+// Tails of regions the arena moved past, one per log2 size class (in words),
+// the last class holding everything bigger.
+#define ARENA_TAIL_CLASSES 8
+
+// ArenaPtr32 counts in units of 1 << ARENA_PTR32_SHIFT bytes (every arena
+// allocation is word aligned), so a reservation can span 32 GB.
+#define ARENA_PTR32_SHIFT 3
+#define ARENA_RESERVE_MAX ((uint64_t)UINT32_MAX << ARENA_PTR32_SHIFT)
+
+// What an arena does with memory it gives back (reset, pop, free).
+typedef enum ArenaSecure {
+    ARENA_SECURE_OFF, // Left as is (default)
+    ARENA_SECURE_SYNC, // Wiped before the call returns
+    ARENA_SECURE_DEFERRED, // Regions leaving the arena are wiped and freed by a background thread
+} ArenaSecure;
+
+typedef struct Arena {
+    Region* start;
+    Region* end;
+    Region* last; // Tail of the region list, end or an idle region past it
+    ArenaGrowth growth;
+    uint32_t region_size; // Least capacity (in words) of a region growth adds, for arenas whose regions were cut to fit
+    uint32_t region_flags; // REGION_MALLOC, REGION_MAPPED or REGION_MEMFD for regions the arena adds
+    struct Arena* parent; // Lends this arena its regions, see arena_create_child
+    Region* pool; // Idle regions, used for growth and lent to children
+    uint32_t borrowed_regions; // Held from the parent
+    uint32_t lent_regions; // Held by children
+    uint32_t header_flags; // Where this struct lives, see ARENA_HEADER_*
+    uint32_t backfill; // Serve requests that miss the current region from tails
+    ArenaSecure secure;
+    Region* tails[ARENA_TAIL_CLASSES];
+    char* reserve; // Base of the reservation holding every region, NULL if none
+    uint64_t reserve_size; // Bytes reserved, 0 for children sharing a parent's
+    uint64_t reserve_used;
+} Arena;
+
+// arena_free releases MALLOC, WITH_REGION and RESERVED headers.
+enum {
+    ARENA_HEADER_MALLOC = 0,
+    ARENA_HEADER_EXTERNAL = 1, // Caller's memory or a parent arena
+    ARENA_HEADER_WITH_REGION = 2, // Same malloc block as the first region (create_arena)
+    ARENA_HEADER_RESERVED = 3, // Start of the reservation, unmapped with it (create_reserved_arena)
+    ARENA_HEADER_BUFFER = 4, // Caller's memory, like the first region (arena_init_from_buffer)
+};
+
+typedef struct ArenaMark {
+    Region* reg;
+    uint32_t count;
+} ArenaMark;
+
+Region* create_region(uint32_t size_bytes);
+Region* create_region_memfd(uint32_t size_bytes);
+// Anonymous private mapping, big regions skip malloc and go straight back to
+// the kernel when freed.
+Region* create_region_mapped(uint32_t size_bytes);
+void* region_allocate(Region* reg, uint32_t size_bytes);
+void region_reset(Region* reg);
+void region_free(Region* reg);
+void print_region(Region* reg);
+
+Arena* create_arena(uint32_t size_bytes);
+// In place setup for an Arena embedded in a struct or on the stack. arena_free
+// releases its regions but not the header. Returns 0 on success.
+int arena_init(Arena* arena, uint32_t size_bytes);
+// Sets up a caller-owned header whose first region is carved out of buf, so
+// nothing touches the heap until buf is full. Later regions are malloc'd as
+// usual and released by arena_free, which leaves the header and buf alone.
+// Returns 0 on success, -1 if buf cannot hold a region.
+int arena_init_from_buffer(Arena* arena, void* buf, size_t size_bytes);
+// Regions are backed by memfds so the arena can be forked with arena_fork.
+Arena* create_forkable_arena(uint32_t size_bytes);
+Arena* create_mapped_arena(uint32_t size_bytes);
+// Reserves reserve_bytes (at most ARENA_RESERVE_MAX) of address space up front
+// and carves the header and every region out of it in order, so all of the
+// arena's memory sits within 32 GB of one base and fits an ArenaPtr32. Pages
+// are only committed when touched. Allocations fail once the reservation is
+// used up, regions dropped by reset are kept for reuse until arena_free.
+Arena* create_reserved_arena(uint64_t reserve_bytes, uint32_t size_bytes);
+// O(1) per region: the child maps the parent's regions copy-on-write and puts
+// its own allocations in new regions, discard it with arena_free. Pages the
+// child has not written yet still show the parent's changes, so leave the
+// parent alone while a child is in use.
+Arena* arena_fork(Arena* arena);
+void* arena_allocate(Arena* arena, uint32_t size_bytes);
+// alignment must be a power of two, anything up to sizeof(uintptr_t) is free.
+void* arena_allocate_aligned(Arena* arena, uint32_t size_bytes, uint32_t alignment);
+// Zeroed count * size_bytes, NULL on overflow. Only memory handed out before
+// (since the region was mapped or last cleared) is cleared again. Clean pages
+// under blocks up to ARENA_CALLOC_EAGER_BYTES get one write so they are
+// committed before the caller reads them.
+void* arena_calloc(Arena* arena, uint32_t count, uint32_t size_bytes);
+// n allocations with one capacity check and bump, laid out back to back in
+// order. Returns 0 and fills out, or -1 if the whole batch does not fit.
+int arena_allocate_batch(Arena* arena, const size_t* sizes, size_t n, void** out);
+void arena_reset(Arena* arena);
+// Reset that also zeroes everything handed out, so arena_calloc after it
+// clears nothing. Worth it when most of the arena will be calloc'd again.
+void arena_reset_zeroed(Arena* arena);
+void arena_free(Arena* arena);
+// Splices src's regions in front of dst's in O(1), so everything allocated
+// from src now belongs to dst and lives until dst is reset or freed, without
+// copying. src is consumed as if by arena_free. Returns 0, or -1 with both
+// arenas untouched for children, parents with children out, reserved, shared
+// or buffer-backed arenas and a secure src going into a dst that is not.
+int arena_merge(Arena* dst, Arena* src);
+void arena_set_growth(Arena* arena, ArenaGrowth growth);
+// Off by default. Allocations that do not fit the current region first try
+// the largest leftover tails of earlier regions. They can land before a
+// scratch mark and so outlive arena_pop_scratch until the next reset.
+void arena_set_backfill(Arena* arena, int enabled);
+// Secure arenas overwrite everything they handed out with zeroes (using
+// non-temporal stores, so scrubbing does not evict the caller's working set)
+// whenever memory goes back. Deferred mode keeps only the first region on
+// reset and hands the rest to the scrubber thread, it needs
+// ARENA_SCRUB_THREAD and is the same as ARENA_SECURE_SYNC without it.
+// Children start with their parent's setting.
+void arena_set_secure(Arena* arena, ArenaSecure secure);
+// A single synchronous wiping reset, whatever the arena's setting.
+void arena_reset_secure(Arena* arena);
+#ifdef ARENA_SCRUB_THREAD
+// Blocks until every region handed to the scrubber has been wiped and freed.
+void arena_scrub_wait(void);
+#endif
+void print_arena(Arena* arena);
+
+// Child arenas borrow every region from their parent's pool (which creates
+// regions only when its pool is empty) and give them back when reset or freed,
+// so nested request, transaction and statement scopes recycle one set of
+// regions. Resetting a child keeps only its first region. The child's header
+// lives in the parent, free children before resetting or freeing the parent.
+Arena* arena_create_child(Arena* parent, uint32_t size_bytes);
+
+ArenaMark arena_scratch(Arena* arena);
+void arena_pop_scratch(Arena* arena, ArenaMark m);
+
+// Rotates between frames arenas, one per tick. Advancing resets the oldest
+// arena and makes it current, so anything allocated lives for exactly frames
+// ticks (the tick it was made in and frames - 1 after it).
+#define FRAME_ARENA_MAX 8
+
+typedef struct FrameArena {
+    Arena* arenas[FRAME_ARENA_MAX];
+    uint32_t frames;
+    uint32_t current;
+    uint64_t tick;
+} FrameArena;
+
+FrameArena* create_frame_arena(uint32_t frames, uint32_t size_bytes);
+void* frame_arena_allocate(FrameArena* frame, uint32_t size_bytes);
+Arena* frame_arena_current(FrameArena* frame);
+void frame_arena_advance(FrameArena* frame);
+void frame_arena_free(FrameArena* frame);
+
+// Epoch based reclamation for lock-free readers. Writers allocate into the
+// current epoch's arena, readers pin the epoch in their own slot for the
+// length of a read. The epoch only advances once every pinned reader has
+// seen the current one, and advancing to e + 1 resets the arena of e - 2 in
+// one go. Whatever is allocated in epoch e has to be unreachable from shared
+// roots by the time the epoch reaches e + 2, so this suits structures a
+// writer republishes every epoch (snapshots, copy-on-write tables) or that
+// copy forward what they keep. Writers and advancing have to be serialized,
+// pinning and unpinning are lock-free.
+#define EPOCH_ARENA_EPOCHS 3
+#define EPOCH_ARENA_READERS 64
+#define EPOCH_ARENA_IDLE UINT64_MAX
+
+typedef struct EpochArenaReader {
+    uint64_t epoch; // Pinned epoch or EPOCH_ARENA_IDLE
+    uint32_t used;
+    char pad[64 - sizeof(uint64_t) - sizeof(uint32_t)]; // One cache line per reader
+} EpochArenaReader;
+
+typedef struct EpochArena {
+    Arena* arenas[EPOCH_ARENA_EPOCHS];
+    uint64_t epoch;
+    EpochArenaReader readers[EPOCH_ARENA_READERS];
+} EpochArena;
+
+EpochArena* create_epoch_arena(uint32_t size_bytes);
+// Returns the reader's slot for pin and unpin, or -1 if all are taken.
+int epoch_arena_register(EpochArena* epochs);
+void epoch_arena_unregister(EpochArena* epochs, int reader);
+uint64_t epoch_arena_pin(EpochArena* epochs, int reader);
+void epoch_arena_unpin(EpochArena* epochs, int reader);
+void* epoch_arena_allocate(EpochArena* epochs, uint32_t size_bytes);
+Arena* epoch_arena_current(EpochArena* epochs);
+// Returns 1 if the epoch advanced, 0 if a reader is still pinned behind it.
+int epoch_arena_advance(EpochArena* epochs);
+void epoch_arena_free(EpochArena* epochs);
+
+// Relocatable arenas are a single region (ARENA_GROWTH_NONE) whose objects
+// refer to each other with self-relative offsets (ArenaRelPtr), so the used
+// part of the region can be written out and later mapped back in and used in
+// place. root is any object in the arena and is handed back by the mapping.
+#define ARENA_IMAGE_MAGIC "STAMIMG"
+#define ARENA_IMAGE_VERSION 1
+
+typedef struct ArenaImageHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t word_size;
+    uint64_t root_offset; // Byte offset of the root from the region's data
+    uint64_t used_bytes;
+    uint64_t capacity; // Words in the region when written, mapped arenas grow by it
+} ArenaImageHeader;
+
+int arena_write_image(Arena* arena, const void* root, const char* path);
+// The mapping is private, so writes stay in this process. The image has no
+// spare capacity, new allocations go to ordinary regions as big as the one
+// that was written.
+Arena* arena_map_image(const char* path, void** root);
+
+// Snapshots store every non-empty region of an arena, page aligned, followed by
+// a relocation table. Any word in the arena whose value points into one of its
+// own regions is treated as a pointer and rebased on restore, so integers that
+// happen to look like arena addresses are rewritten too.
+#define ARENA_SNAPSHOT_MAGIC "STAMSNP"
+#define ARENA_SNAPSHOT_VERSION 1
+
+typedef struct ArenaSnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t word_size;
+    uint64_t region_count;
+    uint64_t reloc_offset; // File offset of the relocation table
+    uint64_t reloc_count;
+    uint64_t root_offset; // File offset of the root, 0 for none
+    // Followed by region_count ArenaSnapshotRegion entries
+} ArenaSnapshotHeader;
+
+typedef struct ArenaSnapshotRegion {
+    uint64_t file_offset; // Of the region header
+    uint64_t data_count;
+    uint64_t capacity; // Of the region in the arena, restored arenas grow by it
+} ArenaSnapshotRegion;
+
+int arena_snapshot(Arena* arena, const void* root, const char* path);
+// Maps the snapshot privately, pages are loaded lazily as they are touched.
+// Restored regions have no spare capacity, regions added later are as big as
+// the largest one in the snapshotted arena.
+Arena* arena_restore(const char* path, void** root);
+
+// Shared arenas are a single region inside a shared memory segment that every
+// process maps at the same address, so raw pointers stay valid across them.
+// The segment comes from memfd_create when name is NULL (shared with children
+// through fork) or from shm_open(name) so unrelated processes can attach.
+// A builder fills the arena and publishes a root; readers wait for the root.
+#define ARENA_SHARED_MAGIC "STAMSHM"
+
+#ifndef ARENA_SHARED_BASE
+#define ARENA_SHARED_BASE 0x500000000000ull // Address hint for new segments
+#endif
+
+typedef struct ArenaSharedHeader {
+    char magic[8];
+    uint64_t base;
+    uint64_t length;
+    uint64_t root; // 0 until published
+    uint64_t reserved[4];
+} ArenaSharedHeader;
+
+Arena* create_shared_arena(const char* name, uint32_t size_bytes);
+// Maps a named segment at the address its creator used. Unlink the name with
+// shm_unlink once every process has attached.
+Arena* arena_attach_shared(const char* name);
+// Lock-free bump allocation, safe from any number of attached processes.
+// arena_allocate also works on a shared arena as long as one process allocates.
+void* arena_allocate_shared(Arena* arena, uint32_t size_bytes);
+void arena_shared_publish(Arena* arena, void* root);
+// Returns the published root, or NULL when there is none yet.
+void* arena_shared_root(Arena* arena);
+
+// Resize ptr, which must have been allocated from arena with old_size_bytes.
+// The most recent allocation grows and shrinks in place, anything else is
+// copied into a fresh allocation when it grows.
+void* arena_realloc(Arena* arena, void* ptr, uint32_t old_size_bytes, uint32_t new_size_bytes);
+
+// String builder that grows in place while it is the arena's most recent
+// allocation. Allocating from the arena mid-build is allowed but the next
+// growth then copies the string.
+typedef struct ArenaString {
+    Arena* arena;
+    char* data;
+    uint32_t length;
+    uint32_t capacity;
+} ArenaString;
+
+ArenaString arena_string_begin(Arena* arena, uint32_t capacity_hint);
+void arena_string_append(ArenaString* str, const char* data, uint32_t length);
+void arena_string_append_cstr(ArenaString* str, const char* cstr);
+void arena_string_appendf(ArenaString* str, const char* fmt, ...);
+// Null terminates the string and hands unused capacity back to the arena.
+const char* arena_string_end(ArenaString* str);
+
+// String interning table owned by an arena. Interned strings and the table
+// itself live in the arena, growing abandons the old table until reset.
+typedef struct ArenaInternEntry {
+    const char* str;
+    uint32_t length;
+    uint32_t hash;
+} ArenaInternEntry;
+
+typedef struct ArenaIntern {
+    Arena* arena;
+    ArenaInternEntry* entries;
+    uint32_t capacity;
+    uint32_t count;
+} ArenaIntern;
+
+void arena_intern_init(ArenaIntern* table, Arena* arena, uint32_t capacity);
+// Returns the canonical null terminated copy of str, equal strings share a pointer.
+const char* arena_intern(ArenaIntern* table, const char* str, uint32_t length);
+const char* arena_intern_cstr(ArenaIntern* table, const char* cstr);
+
+uint32_t arena_hash_bytes(const void* data, uint32_t length);
+int arena_bytes_equal(const void* a, const void* b, uint32_t length);
+
+// Copying compaction: everything reachable from the roots is copied out of
+// src into dst, back to back in the order it is reached, pointers to it are
+// fixed and src is reset. Arena memory is untyped, so callers describe their
+// objects. The visitor hands each root slot to arena_compact_visit with the
+// object's size and a trace function, which does the same for every pointer
+// slot of a copied object. Every visited pointer into src is taken to be
+// the start of an object of the given size, so a pointer into the middle of
+// an object gets a copy of its own, apart from the object around it. Visit
+// only pointers to object starts to keep sharing intact. Pointers outside
+// src are left alone, and src and dst have to be different arenas.
+typedef enum ArenaCompactOrder {
+    ARENA_COMPACT_BFS, // Breadth first, siblings end up side by side
+    ARENA_COMPACT_DFS, // Depth first, each object followed by its first child
+} ArenaCompactOrder;
+
+struct ArenaCompact;
+typedef void (*ArenaCompactTrace)(struct ArenaCompact* compact, void* obj);
+
+typedef struct ArenaCompactSlot {
+    void** slot;
+    uint32_t size;
+    ArenaCompactTrace trace;
+} ArenaCompactSlot;
+
+typedef struct ArenaCompact {
+    Arena* src;
+    Arena* dst;
+    void* user; // For the visitor and trace functions
+    ArenaCompactOrder order;
+    uintptr_t* spans; // Start and end of each used src region, sorted
+    size_t num_spans;
+    uintptr_t* forward; // Open addressing table of (old, new) address pairs
+    size_t forward_capacity;
+    size_t copied;
+    ArenaCompactSlot* work; // Slots waiting to be copied and fixed
+    size_t work_head;
+    size_t work_count;
+    size_t work_capacity;
+    int failed;
+} ArenaCompact;
+
+// Queues *slot to point at a copy of its object of size_bytes, whose own
+// pointers trace (may be NULL) will visit.
+void arena_compact_visit(ArenaCompact* compact, void** slot, uint32_t size_bytes, ArenaCompactTrace trace);
+// Returns the number of objects copied, or -1 on failure (src == dst, out of
+// memory, an object past its region end), in which case src is not reset
+// and every pointer still leads to a valid object.
+int64_t arena_compact(Arena* src, Arena* dst, ArenaCompactOrder order, void (*visitor)(ArenaCompact* compact), void* user);
+
+// Trace file layout: one ArenaTraceHeader followed by ArenaTraceEvent records.
+// Records are written in per-thread batches, so they are only ordered by
+// timestamp within a thread.
+#define ARENA_TRACE_MAGIC "STAMTRC"
+#define ARENA_TRACE_VERSION 1
+
+#ifndef ARENA_TRACE_BUFFER_EVENTS
+#define ARENA_TRACE_BUFFER_EVENTS 4096
+#endif
+
+typedef enum ArenaTraceKind {
+    ARENA_TRACE_CREATE,
+    ARENA_TRACE_ALLOC,
+    ARENA_TRACE_RESET,
+    ARENA_TRACE_FREE,
+} ArenaTraceKind;
+
+typedef struct ArenaTraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t event_size;
+} ArenaTraceHeader;
+
+typedef struct ArenaTraceEvent {
+    uint64_t timestamp_ns;
+    uint64_t arena_id;
+    uint64_t call_site;
+    uint32_t size;
+    uint16_t alignment;
+    uint16_t kind;
+} ArenaTraceEvent;
+
+#ifdef ARENA_TRACE
+
+// Start recording every arena in the process to path. Returns 0 on success.
+// Open before spawning traced threads and close after joining them.
+int arena_trace_open(const char* path);
+// Write the calling thread's buffered events to the trace file.
+void arena_trace_flush(void);
+void arena_trace_close(void);
+void arena_trace_record(ArenaTraceKind kind, Arena* arena, uint32_t size, uint32_t alignment, void* call_site);
+
+#if defined(__GNUC__) || defined(__clang__)
+#define ARENA_TRACE_CALL_SITE __builtin_return_address(0)
+#else
+#define ARENA_TRACE_CALL_SITE NULL
+#endif
+
+#define ARENA_TRACE_EVENT(kind, arena, size) arena_trace_record(kind, arena, size, sizeof(uintptr_t), ARENA_TRACE_CALL_SITE)
+#define ARENA_TRACE_ALIGNED_EVENT(kind, arena, size, alignment) \
+    arena_trace_record(kind, arena, size, alignment, ARENA_TRACE_CALL_SITE)
+#else
+#define ARENA_TRACE_EVENT(kind, arena, size)
+#define ARENA_TRACE_ALIGNED_EVENT(kind, arena, size, alignment)
+#endif // ARENA_TRACE
+
+#ifdef ARENA_REGION_CACHE
+
+// Freed malloc regions are kept in per-thread magazines bucketed by log2 of
+// their capacity. Full magazines spill into a shared depot, which is bounded
+// by the cache limit, and empty ones refill from it.
+#ifndef ARENA_REGION_CACHE_MAGAZINE
+#define ARENA_REGION_CACHE_MAGAZINE 8 // Regions per bucket in each thread
+#endif
+#ifndef ARENA_REGION_CACHE_LIMIT
+#define ARENA_REGION_CACHE_LIMIT (256ull << 20) // Default depot size in bytes
+#endif
+#ifndef ARENA_REGION_CACHE_MAX_REGION
+#define ARENA_REGION_CACHE_MAX_REGION (16ull << 20) // Bigger regions go straight to free
+#endif
+
+#define ARENA_REGION_CACHE_BUCKETS 32
+
+// Bytes the depot may hold, 0 turns the cache off. Magazines already filled
+// are kept until trimmed.
+void arena_region_cache_set_limit(size_t bytes);
+// Bytes currently held by the depot.
+size_t arena_region_cache_bytes(void);
+// Free everything in the depot and the calling thread's magazines.
+void arena_region_cache_trim(void);
+
+#endif // ARENA_REGION_CACHE
+
+#ifdef ARENA_PAGE_MAP
+
+// Every live region is entered page by page into a global two level table,
+// and malloc'd and reserved regions get whole pages so no page holds two of
+// them. Lookups are two loads and a bounds check however many regions exist.
+// Shared regions are left out, and so are parts of arena_init_from_buffer
+// buffers sharing a page with another region. arena_merge also retags each
+// of src's regions.
+#define ARENA_PAGE_SHIFT 12
+#define ARENA_PAGE_MAP_BITS 18 // Per level, covering 48-bit addresses
+
+// The region ptr points into, NULL if it is not arena memory.
+Region* arena_region_of(const void* ptr);
+// 1 if ptr is in one of arena's regions (current or pooled), 0 otherwise.
+// Children own the regions they borrow.
+int arena_owns(Arena* arena, const void* ptr);
+
+#endif // ARENA_PAGE_MAP
+
+#ifdef ARENA_CPP
+
+#include <functional>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// Pointer stored as a byte offset from its own address, so it stays valid when
+// the whole block holding it and its target is moved, written out or mapped
+// at a different address. Zero encodes null.
+template <typename T>
+struct ArenaRelPtr {
+    ArenaRelPtr()
+        : offset(0)
+    {
+    }
+    ArenaRelPtr(T* ptr)
+    {
+        set(ptr);
+    }
+    ArenaRelPtr(const ArenaRelPtr& other)
+    {
+        set(other.get());
+    }
+    ArenaRelPtr& operator=(const ArenaRelPtr& other)
+    {
+        set(other.get());
+        return *this;
+    }
+    ArenaRelPtr& operator=(T* ptr)
+    {
+        set(ptr);
+        return *this;
+    }
+
+    T* get() const
+    {
+        return offset ? (T*)((char*)this + offset) : nullptr;
+    }
+    T* operator->() const
+    {
+        return get();
+    }
+    T& operator*() const
+    {
+        return *get();
+    }
+    explicit operator bool() const
+    {
+        return offset != 0;
+    }
+
+private:
+    void set(T* ptr)
+    {
+        offset = ptr ? (char*)ptr - (char*)this : 0;
+    }
+
+    int64_t offset;
+};
+
+// Pointer into a reserved arena (create_reserved_arena) stored as a 32-bit
+// count of words from the reservation base, half the size of a T*. The base is
+// not stored, pass the arena (or a child of it) to every call. Zero encodes
+// null, the arena header sits there.
+template <typename T>
+struct ArenaPtr32 {
+    ArenaPtr32()
+        : offset(0)
+    {
+    }
+    ArenaPtr32(const Arena* arena, T* ptr)
+    {
+        set(arena, ptr);
+    }
+
+    void set(const Arena* arena, T* ptr)
+    {
+        uint64_t delta = ptr ? (uint64_t)((char*)ptr - arena->reserve) : 0;
+#ifdef ARENA_DEBUG
+        if ((delta & ((1u << ARENA_PTR32_SHIFT) - 1)) || delta > ARENA_RESERVE_MAX) {
+            printf("ArenaPtr32 target %p is misaligned or outside the reservation\n", (void*)ptr);
+            abort();
+        }
+#endif
+        offset = (uint32_t)(delta >> ARENA_PTR32_SHIFT);
+    }
+    T* get(const Arena* arena) const
+    {
+        return offset ? (T*)(arena->reserve + ((uint64_t)offset << ARENA_PTR32_SHIFT)) : nullptr;
+    }
+    explicit operator bool() const
+    {
+        return offset != 0;
+    }
+    bool operator==(const ArenaPtr32& other) const
+    {
+        return offset == other.offset;
+    }
+    bool operator!=(const ArenaPtr32& other) const
+    {
+        return offset != other.offset;
+    }
+
+    uint32_t offset;
+};
+
+// STL allocator handing out arena memory. deallocate is a no-op, memory comes
+// back when the arena is reset.
+template <typename T>
+struct ArenaAllocator {
+    typedef T value_type;
+
+    ArenaAllocator(Arena* arena)
+        : arena(arena)
+    {
+    }
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other)
+        : arena(other.arena)
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        if (n > UINT32_MAX / sizeof(T)) {
+            throw std::bad_alloc();
+        }
+        T* res = (T*)arena_allocate_aligned(arena, (uint32_t)(n * sizeof(T)), alignof(T));
+        if (!res) {
+            throw std::bad_alloc();
+        }
+        return res;
+    }
+
+    void deallocate(T*, size_t)
+    {
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const
+    {
+        return arena == other.arena;
+    }
+
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const
+    {
+        return arena != other.arena;
+    }
+
+    Arena* arena;
+};
+
+// Open-addressing hash map in the style of a Swiss table: one control byte per
+// slot holding 7 bits of the hash, scanned 16 at a time with SSE2. Control
+// bytes and slots live in the arena, growing rehashes into fresh arena memory
+// and abandons the old table until the arena is reset. Entries are destroyed
+// when the map is, but their memory only returns with the arena.
+template <typename K, typename V, typename Hash = std::hash<K>, typename Eq = std::equal_to<K>>
+struct ArenaHashMap {
+    struct Slot {
+        K key;
+        V value;
+    };
+
+    ArenaHashMap(Arena* arena, size_t capacity = 0)
+        : arena(arena)
+    {
+        if (capacity) {
+            reserve(capacity);
+        }
+    }
+    ~ArenaHashMap()
+    {
+        destroy(ctrl, slots, cap);
+    }
+    ArenaHashMap(const ArenaHashMap&) = delete;
+    ArenaHashMap& operator=(const ArenaHashMap&) = delete;
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    size_t capacity() const
+    {
+        return cap;
+    }
+
+    V* find(const K& key)
+    {
+        size_t i = find_index(key, hash(key));
+        return i == cap ? nullptr : &slots[i].value;
+    }
+
+    // Returns the value for key and whether it was newly constructed from args.
+    template <typename... Args>
+    std::pair<V*, bool> emplace(const K& key, Args&&... args)
+    {
+        size_t h = hash(key);
+        size_t found = find_index(key, h);
+        if (found != cap) {
+            return std::pair<V*, bool>(&slots[found].value, false);
+        }
+        if ((count + tombstones + 1) * 8 > cap * 7) {
+            // Double when mostly live, otherwise just clear out tombstones.
+            size_t new_cap = cap ? cap : GROUP;
+            if ((count + 1) * 2 > new_cap) {
+                new_cap *= 2;
+            }
+            rehash(new_cap);
+            if ((count + tombstones + 1) * 8 > cap * 7) {
+                return std::pair<V*, bool>(nullptr, false);
+            }
+        }
+
+        size_t i = free_slot(h);
+        if (ctrl[i] == DELETED) {
+            tombstones -= 1;
+        }
+        ctrl[i] = (int8_t)(h & 0x7F);
+        new (&slots[i].key) K(key);
+        new (&slots[i].value) V(std::forward<Args>(args)...);
+        count += 1;
+        return std::pair<V*, bool>(&slots[i].value, true);
+    }
+
+    bool insert(const K& key, const V& value)
+    {
+        return emplace(key, value).second;
+    }
+
+    V& operator[](const K& key)
+    {
+        V* value = emplace(key).first;
+        if (!value) {
+            throw std::bad_alloc();
+        }
+        return *value;
+    }
+
+    bool erase(const K& key)
+    {
+        size_t i = find_index(key, hash(key));
+        if (i == cap) {
+            return false;
+        }
+        slots[i].~Slot();
+        ctrl[i] = DELETED;
+        count -= 1;
+        tombstones += 1;
+        return true;
+    }
+
+    // Drops every entry but keeps the current table.
+    void clear()
+    {
+        destroy(ctrl, slots, cap);
+        if (cap) {
+            memset(ctrl, EMPTY, cap);
+        }
+        count = 0;
+        tombstones = 0;
+    }
+
+    void reserve(size_t n)
+    {
+        size_t new_cap = GROUP;
+        while (new_cap * 7 < n * 8) {
+            new_cap *= 2;
+        }
+        if (new_cap > cap) {
+            rehash(new_cap);
+        }
+    }
+
+    template <typename F>
+    void for_each(F f)
+    {
+        for (size_t i = 0; i < cap; i++) {
+            if (ctrl[i] >= 0) {
+                f(slots[i].key, slots[i].value);
+            }
+        }
+    }
+
+private:
+    static const size_t GROUP = 16;
+    static const int8_t EMPTY = -128;
+    static const int8_t DELETED = -2;
+
+    static size_t hash(const K& key)
+    {
+        uint64_t h = (uint64_t)Hash()(key) * 0x9E3779B97F4A7C15ull;
+        return (size_t)(h ^ (h >> 32));
+    }
+
+    // Index of key's slot, or cap when it is absent.
+    size_t find_index(const K& key, size_t h) const
+    {
+        if (!cap) {
+            return cap;
+        }
+        int8_t tag = (int8_t)(h & 0x7F);
+        size_t mask = cap / GROUP - 1;
+        size_t g = (h >> 7) & mask;
+
+        for (size_t step = 1;; step++) {
+            const int8_t* group = &ctrl[g * GROUP];
+            for (uint32_t m = match(group, tag); m; m &= m - 1) {
+                size_t i = g * GROUP + __builtin_ctz(m);
+                if (Eq()(slots[i].key, key)) {
+                    return i;
+                }
+            }
+            if (match(group, EMPTY)) {
+                return cap;
+            }
+            g = (g + step) & mask;
+        }
+    }
+
+    // Bit i is set when group[i] == tag.
+    static uint32_t match(const int8_t* group, int8_t tag)
+    {
+#if defined(__SSE2__)
+        __m128i g = _mm_loadu_si128((const __m128i*)group);
+        return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(tag)));
+#else
+        uint32_t m = 0;
+        for (size_t i = 0; i < GROUP; i++) {
+            m |= (uint32_t)(group[i] == tag) << i;
+        }
+        return m;
+#endif
+    }
+
+    // Bit i is set when group[i] is empty or deleted.
+    static uint32_t match_free(const int8_t* group)
+    {
+#if defined(__SSE2__)
+        return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+#else
+        uint32_t m = 0;
+        for (size_t i = 0; i < GROUP; i++) {
+            m |= (uint32_t)(group[i] < 0) << i;
+        }
+        return m;
+#endif
+    }
+
+    size_t free_slot(size_t h) const
+    {
+        size_t mask = cap / GROUP - 1;
+        size_t g = (h >> 7) & mask;
+        for (size_t step = 1;; step++) {
+            uint32_t m = match_free(&ctrl[g * GROUP]);
+            if (m) {
+                return g * GROUP + __builtin_ctz(m);
+            }
+            g = (g + step) & mask;
+        }
+    }
+
+    void rehash(size_t new_cap)
+    {
+        if (new_cap > UINT32_MAX / sizeof(Slot)) {
+            printf("Failed to grow ArenaHashMap to %zu slots\n", new_cap);
+            return;
+        }
+        int8_t* new_ctrl = (int8_t*)arena_allocate(arena, (uint32_t)new_cap);
+        Slot* new_slots = (Slot*)arena_allocate_aligned(arena, (uint32_t)(new_cap * sizeof(Slot)), alignof(Slot));
+        if (!new_ctrl || !new_slots) {
+            printf("Failed to grow ArenaHashMap to %zu slots\n", new_cap);
+            return;
+        }
+        memset(new_ctrl, EMPTY, new_cap);
+
+        int8_t* old_ctrl = ctrl;
+        Slot* old_slots = slots;
+        size_t old_cap = cap;
+        ctrl = new_ctrl;
+        slots = new_slots;
+        cap = new_cap;
+        tombstones = 0;
+
+        for (size_t i = 0; i < old_cap; i++) {
+            if (old_ctrl[i] < 0) {
+                continue;
+            }
+            size_t h = hash(old_slots[i].key);
+            size_t j = free_slot(h);
+            ctrl[j] = (int8_t)(h & 0x7F);
+            new (&slots[j].key) K(std::move(old_slots[i].key));
+            new (&slots[j].value) V(std::move(old_slots[i].value));
+        }
+        destroy(old_ctrl, old_slots, old_cap);
+    }
+
+    static void destroy(int8_t* ctrl, Slot* slots, size_t cap)
+    {
+        for (size_t i = 0; i < cap; i++) {
+            if (ctrl[i] >= 0) {
+                slots[i].~Slot();
+            }
+        }
+    }
+
+    Arena* arena;
+    int8_t* ctrl = nullptr;
+    Slot* slots = nullptr;
+    size_t cap = 0;
+    size_t count = 0;
+    size_t tombstones = 0;
+};
+
+// Append-only list stored in arena chunks that double in size, so elements
+// never move once pushed. Chunk k holds first_chunk << k elements, which keeps
+// indexing O(1) and lets each chunk be handed to a different thread.
+template <typename T>
+struct ArenaChunkList {
+    static const uint32_t MAX_CHUNKS = 32;
+
+    // first_chunk is rounded up to a power of two.
+    ArenaChunkList(Arena* arena, uint32_t first_chunk = 16)
+        : arena(arena)
+    {
+        shift = 0;
+        while ((1u << shift) < first_chunk) {
+            shift += 1;
+        }
+    }
+    ~ArenaChunkList()
+    {
+        clear();
+    }
+    ArenaChunkList(const ArenaChunkList&) = delete;
+    ArenaChunkList& operator=(const ArenaChunkList&) = delete;
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+
+    template <typename... Args>
+    T* emplace_back(Args&&... args)
+    {
+        uint32_t k = chunk_of(count);
+        if (k == num_chunks) {
+            if (k == MAX_CHUNKS) {
+                return nullptr;
+            }
+            if (chunk_capacity(k) > UINT32_MAX / sizeof(T)) {
+                printf("ArenaChunkList chunk %" PRIu32 " is too big for an arena allocation\n", k);
+                return nullptr;
+            }
+            size_t bytes = chunk_capacity(k) * sizeof(T);
+            chunks[k] = (T*)arena_allocate_aligned(arena, (uint32_t)bytes, alignof(T));
+            if (!chunks[k]) {
+                printf("Failed to allocate ArenaChunkList chunk of %zu bytes\n", bytes);
+                return nullptr;
+            }
+            num_chunks += 1;
+        }
+        T* res = new (&chunks[k][count - chunk_start(k)]) T(std::forward<Args>(args)...);
+        count += 1;
+        return res;
+    }
+
+    T* push_back(const T& value)
+    {
+        return emplace_back(value);
+    }
+
+    T& operator[](size_t i)
+    {
+        uint32_t k = chunk_of(i);
+        return chunks[k][i - chunk_start(k)];
+    }
+
+    // Destroys every element but keeps the chunks for reuse.
+    void clear()
+    {
+        for_each_chunk([](T* data, size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                data[i].~T();
+            }
+        });
+        count = 0;
+    }
+
+    // Chunks in use, chunk k holds chunk_size(k) contiguous elements.
+    uint32_t chunk_count() const
+    {
+        return count ? chunk_of(count - 1) + 1 : 0;
+    }
+
+    T* chunk_data(uint32_t k)
+    {
+        return chunks[k];
+    }
+
+    size_t chunk_size(uint32_t k) const
+    {
+        size_t remaining = count - chunk_start(k);
+        return remaining < chunk_capacity(k) ? remaining : chunk_capacity(k);
+    }
+
+    template <typename F>
+    void for_each_chunk(F f)
+    {
+        uint32_t n = chunk_count();
+        for (uint32_t k = 0; k < n; k++) {
+            f(chunks[k], chunk_size(k));
+        }
+    }
+
+    struct iterator {
+        ArenaChunkList* list;
+        size_t index;
+        T* ptr;
+        T* chunk_end;
+        uint32_t k;
+
+        T& operator*() const
+        {
+            return *ptr;
+        }
+        T* operator->() const
+        {
+            return ptr;
+        }
+        iterator& operator++()
+        {
+            index += 1;
+            if (++ptr == chunk_end && index < list->count) {
+                k += 1;
+                ptr = list->chunks[k];
+                chunk_end = ptr + list->chunk_capacity(k);
+            }
+            return *this;
+        }
+        bool operator==(const iterator& other) const
+        {
+            return index == other.index;
+        }
+        bool operator!=(const iterator& other) const
+        {
+            return index != other.index;
+        }
+    };
+
+    iterator begin()
+    {
+        if (!chunks[0]) {
+            return end();
+        }
+        iterator it = { this, 0, chunks[0], chunks[0] + chunk_capacity(0), 0 };
+        return it;
+    }
+
+    iterator end()
+    {
+        iterator it = { this, count, nullptr, nullptr, 0 };
+        return it;
+    }
+
+private:
+    size_t chunk_capacity(uint32_t k) const
+    {
+        return (size_t)1 << (shift + k);
+    }
+
+    // Index of the first element in chunk k.
+    size_t chunk_start(uint32_t k) const
+    {
+        return (((size_t)1 << k) - 1) << shift;
+    }
+
+    uint32_t chunk_of(size_t i) const
+    {
+        return 63 - __builtin_clzll((unsigned long long)((i >> shift) + 1));
+    }
+
+    Arena* arena;
+    T* chunks[MAX_CHUNKS] = {};
+    uint32_t num_chunks = 0;
+    uint32_t shift;
+    size_t count = 0;
+};
+
+// Policies for BasicArena. Each is a compile time choice, so an arena only
+// carries the locking, counting and checking its policy asks for. Build a
+// policy by deriving from ArenaDefaultPolicy and replacing members.
+struct ArenaNoLock {
+    void lock() { }
+    void unlock() { }
+};
+
+struct ArenaSpinLock {
+    void lock()
+    {
+        while (__atomic_test_and_set(&locked, __ATOMIC_ACQUIRE)) {
+            while (__atomic_load_n(&locked, __ATOMIC_RELAXED)) {
+#if defined(__SSE2__)
+                _mm_pause();
+#endif
+            }
+        }
+    }
+    void unlock()
+    {
+        __atomic_clear(&locked, __ATOMIC_RELEASE);
+    }
+
+    bool locked = false;
+};
+
+struct ArenaNoStats {
+    void on_allocate(uint32_t) { }
+    void on_reset() { }
+    void on_merge(const ArenaNoStats&) { }
+};
+
+struct ArenaCountStats {
+    void on_allocate(uint32_t size_bytes)
+    {
+        allocations += 1;
+        bytes += size_bytes;
+    }
+    void on_reset()
+    {
+        resets += 1;
+    }
+    void on_merge(const ArenaCountStats& other)
+    {
+        allocations += other.allocations;
+        bytes += other.bytes;
+        resets += other.resets;
+    }
+
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+    uint64_t resets = 0;
+};
+
+struct ArenaNoChecks {
+    static void check(bool, const char*) { }
+};
+
+struct ArenaAbortChecks {
+    static void check(bool ok, const char* what)
+    {
+        if (!ok) {
+            printf("Arena check failed: %s\n", what);
+            abort();
+        }
+    }
+};
+
+// Backings live inside the BasicArena, so they can hold the arena's memory.
+struct ArenaMallocBacking {
+    Arena* create(uint32_t size_bytes)
+    {
+        return create_arena(size_bytes);
+    }
+};
+
+struct ArenaMmapBacking {
+    Arena* create(uint32_t size_bytes)
+    {
+        return create_mapped_arena(size_bytes);
+    }
+};
+
+// All regions come out of one reservation of R bytes, see ArenaPtr32.
+template <uint64_t R>
+struct ArenaReservedBacking {
+    Arena* create(uint32_t size_bytes)
+    {
+        return create_reserved_arena(R, size_bytes);
+    }
+};
+
+// First N bytes come from the object itself (the stack, for a local), later
+// regions are malloc'd with the same capacity.
+template <uint32_t N>
+struct ArenaBufferBacking {
+    static constexpr uint32_t default_size = N;
+
+    Arena* create(uint32_t)
+    {
+        return arena_init_from_buffer(&header, buffer, N) == 0 ? &header : nullptr;
+    }
+
+    Arena header;
+    alignas(uintptr_t) unsigned char buffer[N];
+};
+
+struct ArenaDefaultPolicy {
+    static constexpr uint32_t alignment = sizeof(uintptr_t); // Minimum, types may ask for more
+    static constexpr ArenaGrowth growth = ARENA_GROWTH_FIXED;
+    typedef ArenaNoLock Lock;
+    typedef ArenaNoStats Stats;
+    typedef ArenaNoChecks Checks;
+    typedef ArenaMallocBacking Backing;
+};
+
+// 0..N-1 as a pack (std::index_sequence is C++14).
+template <size_t... I>
+struct ArenaIndices {
+};
+
+template <size_t N, size_t... I>
+struct ArenaMakeIndices : ArenaMakeIndices<N - 1, N - 1, I...> {
+};
+
+template <size_t... I>
+struct ArenaMakeIndices<0, I...> {
+    typedef ArenaIndices<I...> type;
+};
+
+// Contiguous run of T, what ArenaSoA hands out for each column.
+template <typename T>
+struct ArenaSpan {
+    T* begin() const
+    {
+        return data;
+    }
+    T* end() const
+    {
+        return data + size;
+    }
+    T& operator[](size_t i) const
+    {
+        return data[i];
+    }
+
+    T* data;
+    size_t size;
+};
+
+#ifndef ARENA_SOA_ALIGN
+#define ARENA_SOA_ALIGN 64 // Column alignment, a cache line
+#endif
+
+template <typename... Ts>
+struct ArenaAllTrivial : std::true_type {
+};
+
+template <typename T, typename... Ts>
+struct ArenaAllTrivial<T, Ts...>
+    : std::integral_constant<bool, std::is_trivially_copyable<T>::value && ArenaAllTrivial<Ts...>::value> {
+};
+
+// Table stored column by column, one aligned arena block per field, so loops
+// over a few fields only touch those fields and vectorize. All columns grow
+// together by doubling, old blocks stay in the arena until it is reset.
+template <typename... Fields>
+struct ArenaSoA {
+    static_assert(ArenaAllTrivial<Fields...>::value, "ArenaSoA columns are moved with memcpy");
+    static const size_t NUM_COLUMNS = sizeof...(Fields);
+
+    template <size_t I>
+    using Column = typename std::tuple_element<I, std::tuple<Fields...>>::type;
+
+    ArenaSoA(Arena* arena, size_t capacity = 0)
+        : arena(arena)
+    {
+        if (capacity) {
+            reserve(capacity);
+        }
+    }
+    ArenaSoA(const ArenaSoA&) = delete;
+    ArenaSoA& operator=(const ArenaSoA&) = delete;
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    size_t capacity() const
+    {
+        return cap;
+    }
+
+    bool reserve(size_t n)
+    {
+        if (n <= cap) {
+            return true;
+        }
+        const size_t sizes[] = { sizeof(Fields)... };
+        void* grown[NUM_COLUMNS];
+        for (size_t i = 0; i < NUM_COLUMNS; i++) {
+            uint64_t bytes = (uint64_t)n * sizes[i];
+            grown[i] = bytes <= UINT32_MAX ? arena_allocate_aligned(arena, (uint32_t)bytes, ARENA_SOA_ALIGN) : nullptr;
+            if (!grown[i]) {
+                printf("Failed to allocate ArenaSoA column of %" PRIu64 " bytes\n", bytes);
+                return false;
+            }
+        }
+        for (size_t i = 0; i < NUM_COLUMNS; i++) {
+            if (count) {
+                memcpy(grown[i], columns[i], count * sizes[i]);
+            }
+            columns[i] = grown[i];
+        }
+        cap = n;
+        return true;
+    }
+
+    // New rows are left uninitialized.
+    bool resize(size_t n)
+    {
+        if (n > cap && !reserve(n)) {
+            return false;
+        }
+        count = n;
+        return true;
+    }
+
+    bool push_back(const Fields&... values)
+    {
+        if (count == cap && !reserve(cap ? cap * 2 : 16)) {
+            return false;
+        }
+        store(typename ArenaMakeIndices<NUM_COLUMNS>::type(), values...);
+        count += 1;
+        return true;
+    }
+
+    void clear()
+    {
+        count = 0;
+    }
+
+    template <size_t I>
+    ArenaSpan<Column<I>> column()
+    {
+        ArenaSpan<Column<I>> span = { (Column<I>*)columns[I], count };
+        return span;
+    }
+
+private:
+    template <size_t... I>
+    void store(ArenaIndices<I...>, const Fields&... values)
+    {
+        int expand[] = { 0, ((void)(((Fields*)columns[I])[count] = values), 0)... };
+        (void)expand;
+    }
+
+    Arena* arena;
+    void* columns[NUM_COLUMNS] = {};
+    size_t count = 0;
+    size_t cap = 0;
+};
+
+template <typename Policy = ArenaDefaultPolicy>
+struct BasicArena {
+    static_assert((Policy::alignment & (Policy::alignment - 1)) == 0, "alignment must be a power of two");
+
+    // Only for backings that know their own size.
+    BasicArena()
+        : BasicArena(Policy::Backing::default_size)
+    {
+    }
+    BasicArena(uint32_t size_bytes)
+    {
+        arena = backing.create(size_bytes);
+        Policy::Checks::check(arena != nullptr, "arena creation failed");
+        if (arena && Policy::growth != ARENA_GROWTH_FIXED) {
+            arena_set_growth(arena, Policy::growth);
+        }
+    }
+    ~BasicArena()
+    {
+        if (arena) {
+            arena_free(arena);
+        }
+    }
+    BasicArena(const BasicArena&) = delete;
+    BasicArena& operator=(const BasicArena&) = delete;
+
+    // Bumps the current region inline and only calls into the C arena when
+    // it is full (or when debug and trace builds need to see every call).
+    template <uint32_t Align = Policy::alignment>
+    void* allocate_bytes(uint32_t size_bytes)
+    {
+        static_assert((Align & (Align - 1)) == 0, "alignment must be a power of two");
+
+        lock.lock();
+#if defined(ARENA_DEBUG) || defined(ARENA_TRACE)
+        void* res = arena_allocate_aligned(arena, size_bytes, Align);
+#else
+        void* res;
+        Region* reg = arena->end;
+        uintptr_t top = (uintptr_t)&reg->data[reg->data_count];
+        uintptr_t aligned = (top + Align - 1) & ~(uintptr_t)(Align - 1);
+        size_t size = (aligned - top) / sizeof(uintptr_t) + ALIGN_SIZE(size_bytes);
+        if (size <= reg->capacity - reg->data_count) {
+            reg->data_count += (uint32_t)size;
+            res = (void*)aligned;
+        } else {
+            res = arena_allocate_aligned(arena, size_bytes, Align);
+        }
+#endif
+        stats.on_allocate(size_bytes);
+        lock.unlock();
+
+        Policy::Checks::check(res != nullptr, "allocation failed");
+        Policy::Checks::check(((uintptr_t)res & (Align - 1)) == 0, "misaligned allocation");
+        return res;
+    }
+
+    template <typename T, typename... Args>
+    T* construct(Args&&... args)
+    {
+        void* obj = allocate_bytes<align_of<T>()>(sizeof(T));
+        return obj ? new (obj) T(std::forward<Args>(args)...) : nullptr;
+    };
+
+    // Uninitialized storage for a T.
+    template <typename T>
+    T* allocate()
+    {
+        return (T*)allocate_bytes<align_of<T>()>(sizeof(T));
+    };
+
+    template <typename T, typename Arg, typename... Args>
+    T* allocate(Arg&& arg, Args&&... args)
+    {
+        return construct<T>(std::forward<Arg>(arg), std::forward<Args>(args)...);
+    };
+
+    // Uninitialized storage for one of each type from a single bump, in order.
+    template <typename... Ts>
+    std::tuple<Ts*...> allocate_many()
+    {
+        const uint32_t sizes[] = { (uint32_t)sizeof(Ts)... };
+        const uint32_t aligns[] = { align_of<Ts>()... };
+        uint32_t offsets[sizeof...(Ts)];
+        uint32_t total = 0;
+        for (size_t i = 0; i < sizeof...(Ts); i++) {
+            total = (total + aligns[i] - 1) & ~(aligns[i] - 1);
+            offsets[i] = total;
+            total += sizes[i];
+        }
+
+        char* base = (char*)allocate_bytes<max_align_of<Ts...>()>(total);
+        if (!base) {
+            return std::tuple<Ts*...>();
+        }
+        return pointers_at<Ts...>(base, offsets, typename ArenaMakeIndices<sizeof...(Ts)>::type());
+    }
+
+    ArenaMark mark()
+    {
+        lock.lock();
+        ArenaMark m = arena_scratch(arena);
+        lock.unlock();
+        return m;
+    }
+
+    void reset()
+    {
+        lock.lock();
+        arena_reset(arena);
+        stats.on_reset();
+        lock.unlock();
+    }
+
+    void reset(ArenaMark mark)
+    {
+        Policy::Checks::check(mark.reg != nullptr, "reset to an empty mark");
+        lock.lock();
+        arena_pop_scratch(arena, mark);
+        stats.on_reset();
+        lock.unlock();
+    }
+
+    // Takes over everything other allocated without copying (see
+    // arena_merge). other is left empty and may only be destroyed.
+    bool adopt(BasicArena& other)
+    {
+        lock.lock();
+        other.lock.lock();
+        bool ok = other.arena && arena_merge(arena, other.arena) == 0;
+        if (ok) {
+            other.arena = nullptr;
+            stats.on_merge(other.stats);
+        }
+        other.lock.unlock();
+        lock.unlock();
+        Policy::Checks::check(ok, "arena merge failed");
+        return ok;
+    }
+
+    void print()
+    {
+        print_arena(arena);
+    }
+
+    Arena* get()
+    {
+        return arena;
+    }
+
+    typename Policy::Stats& get_stats()
+    {
+        return stats;
+    }
+
+    // The allocator goes to the C arena directly and does not take the lock.
+    template <typename T>
+    ArenaAllocator<T> allocator()
+    {
+        return ArenaAllocator<T>(arena);
+    }
+
+private:
+    template <typename T>
+    static constexpr uint32_t align_of()
+    {
+        return alignof(T) > Policy::alignment ? (uint32_t)alignof(T) : Policy::alignment;
+    }
+
+    template <typename T>
+    static constexpr uint32_t max_align_of()
+    {
+        return align_of<T>();
+    }
+
+    template <typename... Ts, size_t... I>
+    static std::tuple<Ts*...> pointers_at(char* base, const uint32_t* offsets, ArenaIndices<I...>)
+    {
+        return std::tuple<Ts*...>((Ts*)(base + offsets[I])...);
+    }
+
+    template <typename T, typename U, typename... Rest>
+    static constexpr uint32_t max_align_of()
+    {
+        return align_of<T>() > max_align_of<U, Rest...>() ? align_of<T>() : max_align_of<U, Rest...>();
+    }
+
+    typename Policy::Backing backing;
+    Arena* arena;
+    typename Policy::Lock lock;
+    typename Policy::Stats stats;
+};
+
+typedef BasicArena<> ArenaCPP;
+
+template <uint32_t N>
+struct ArenaInlinePolicy : ArenaDefaultPolicy {
+    typedef ArenaBufferBacking<N> Backing;
+};
+
+// Scratch space for a function: up to N bytes without touching the heap.
+template <uint32_t N>
+using InlineArena = BasicArena<ArenaInlinePolicy<N>>;
+
+#endif // ARENA_CPP
+
+#ifdef ARENA_IMPLEMENTATION
+
+#include <fcntl.h>
+#include <stdarg.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef ARENA_CALLOC_EAGER_BYTES
+#define ARENA_CALLOC_EAGER_BYTES (8u << 10) // arena_calloc commits clean pages of blocks this small
+#endif
+
+#ifndef ARENA_STREAM_THRESHOLD
+#define ARENA_STREAM_THRESHOLD (256u << 10) // Clears at least this big skip the cache
+#endif
+
+// Mapped images keep their region page aligned in the file.
+#define ARENA_IMAGE_DATA_OFFSET 4096
+#define ARENA_PAGE_ALIGN(size) (((size) + 4095) & ~(uint64_t)4095)
+#define ARENA_HEADER_BYTES (ALIGN_SIZE(sizeof(Arena)) * sizeof(uintptr_t))
+
+#ifdef ARENA_ASAN
+// Redzones are read (and then ignored) when whole regions are scanned.
+#define ARENA_NO_SANITIZE __attribute__((no_sanitize_address))
+#else
+#define ARENA_NO_SANITIZE
+#endif
+
+#ifdef ARENA_TRACE
+#include <pthread.h>
+#include <time.h>
+
+typedef struct ArenaTraceBuffer {
+    uint32_t head;
+    ArenaTraceEvent events[ARENA_TRACE_BUFFER_EVENTS];
+} ArenaTraceBuffer;
+
+static FILE* arena_trace_file = NULL;
+static pthread_key_t arena_trace_key;
+static pthread_once_t arena_trace_key_once = PTHREAD_ONCE_INIT;
+// Only ever touched by its owning thread, so recording needs no locks. The
+// stdio lock inside fwrite serializes flushes from different threads.
+static ARENA_THREAD_LOCAL ArenaTraceBuffer* arena_trace_buffer = NULL;
+
+static void arena_trace_write(ArenaTraceBuffer* buf)
+{
+    FILE* file = __atomic_load_n(&arena_trace_file, __ATOMIC_ACQUIRE);
+    if (file && buf->head) {
+        fwrite(buf->events, sizeof(ArenaTraceEvent), buf->head, file);
+    }
+    buf->head = 0;
+}
+
+static void arena_trace_thread_exit(void* ptr)
+{
+    ArenaTraceBuffer* buf = (ArenaTraceBuffer*)ptr;
+    arena_trace_write(buf);
+    free(buf);
+}
+
+static void arena_trace_make_key(void)
+{
+    pthread_key_create(&arena_trace_key, arena_trace_thread_exit);
+}
+
+int arena_trace_open(const char* path)
+{
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        printf("Failed to open arena trace file: %s\n", path);
+        return -1;
+    }
+
+    ArenaTraceHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ARENA_TRACE_MAGIC, sizeof(ARENA_TRACE_MAGIC));
+    header.version = ARENA_TRACE_VERSION;
+    header.event_size = sizeof(ArenaTraceEvent);
+    fwrite(&header, sizeof(header), 1, file);
+
+    pthread_once(&arena_trace_key_once, arena_trace_make_key);
+    __atomic_store_n(&arena_trace_file, file, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void arena_trace_flush(void)
+{
+    if (arena_trace_buffer) {
+        arena_trace_write(arena_trace_buffer);
+    }
+    FILE* file = __atomic_load_n(&arena_trace_file, __ATOMIC_ACQUIRE);
+    if (file) {
+        fflush(file);
+    }
+}
+
+void arena_trace_close(void)
+{
+    arena_trace_flush();
+    FILE* file = __atomic_exchange_n(&arena_trace_file, (FILE*)NULL, __ATOMIC_ACQ_REL);
+    if (file) {
+        fclose(file);
+    }
+}
+
+void arena_trace_record(ArenaTraceKind kind, Arena* arena, uint32_t size, uint32_t alignment, void* call_site)
+{
+    if (!__atomic_load_n(&arena_trace_file, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    ArenaTraceBuffer* buf = arena_trace_buffer;
+    if (!buf) {
+        buf = (ArenaTraceBuffer*)malloc(sizeof(ArenaTraceBuffer));
+        if (!buf) {
+            return;
+        }
+        buf->head = 0;
+        arena_trace_buffer = buf;
+        pthread_setspecific(arena_trace_key, buf);
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    ArenaTraceEvent* ev = &buf->events[buf->head];
+    ev->timestamp_ns = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    ev->arena_id = (uint64_t)(uintptr_t)arena;
+    ev->call_site = (uint64_t)(uintptr_t)call_site;
+    ev->size = size;
+    ev->alignment = (uint16_t)(alignment < 32768 ? alignment : 32768);
+    ev->kind = (uint16_t)kind;
+
+    if (++buf->head == ARENA_TRACE_BUFFER_EVENTS) {
+        arena_trace_write(buf);
+    }
+}
+
+#endif // ARENA_TRACE
+
+#ifdef ARENA_REGION_CACHE
+#include <pthread.h>
+
+typedef struct ArenaMagazine {
+    Region* regions[ARENA_REGION_CACHE_BUCKETS];
+    uint32_t counts[ARENA_REGION_CACHE_BUCKETS];
+    int registered;
+} ArenaMagazine;
+
+static ARENA_THREAD_LOCAL ArenaMagazine arena_magazine;
+static pthread_mutex_t arena_depot_lock = PTHREAD_MUTEX_INITIALIZER;
+static Region* arena_depot[ARENA_REGION_CACHE_BUCKETS];
+static size_t arena_depot_bytes = 0;
+static size_t arena_depot_limit = ARENA_REGION_CACHE_LIMIT;
+static pthread_key_t arena_magazine_key;
+static pthread_once_t arena_magazine_key_once = PTHREAD_ONCE_INIT;
+
+static inline size_t arena_region_bytes(Region* reg)
+{
+    return sizeof(Region) + (size_t)reg->capacity * sizeof(uintptr_t);
+}
+
+static inline uint32_t arena_region_bucket(uint32_t capacity)
+{
+    return capacity ? 31 - (uint32_t)__builtin_clz(capacity) : 0;
+}
+
+// Moves a whole magazine bucket into the depot, or frees it when that would
+// go over the limit.
+static void arena_magazine_spill(ArenaMagazine* mag, uint32_t bucket)
+{
+    Region* head = mag->regions[bucket];
+    if (!head) {
+        return;
+    }
+
+    size_t bytes = 0;
+    Region* tail = head;
+    for (Region* reg = head; reg; reg = reg->next) {
+        bytes += arena_region_bytes(reg);
+        tail = reg;
+    }
+
+    int kept = 0;
+    pthread_mutex_lock(&arena_depot_lock);
+    if (arena_depot_bytes + bytes <= arena_depot_limit) {
+        tail->next = arena_depot[bucket];
+        arena_depot[bucket] = head;
+        arena_depot_bytes += bytes;
+        kept = 1;
+    }
+    pthread_mutex_unlock(&arena_depot_lock);
+
+    if (!kept) {
+        while (head) {
+            Region* next = head->next;
+            free(head);
+            head = next;
+        }
+    }
+    mag->regions[bucket] = NULL;
+    mag->counts[bucket] = 0;
+}
+
+static void arena_magazine_thread_exit(void* ptr)
+{
+    ArenaMagazine* mag = (ArenaMagazine*)ptr;
+    for (uint32_t b = 0; b < ARENA_REGION_CACHE_BUCKETS; b++) {
+        arena_magazine_spill(mag, b);
+    }
+}
+
+static void arena_magazine_make_key(void)
+{
+    pthread_key_create(&arena_magazine_key, arena_magazine_thread_exit);
+}
+
+// The calling thread's magazine, registered on first use so whatever it
+// holds is spilled to the depot when the thread exits.
+static ArenaMagazine* arena_magazine_get(void)
+{
+    ArenaMagazine* mag = &arena_magazine;
+    if (!mag->registered) {
+        pthread_once(&arena_magazine_key_once, arena_magazine_make_key);
+        pthread_setspecific(arena_magazine_key, mag);
+        mag->registered = 1;
+    }
+    return mag;
+}
+
+// Half a magazine per trip to the depot so a thread that only allocates does
+// not take the lock for every region.
+static void arena_magazine_refill(ArenaMagazine* mag, uint32_t bucket)
+{
+    if (!__atomic_load_n(&arena_depot[bucket], __ATOMIC_RELAXED)) {
+        return;
+    }
+    pthread_mutex_lock(&arena_depot_lock);
+    uint32_t want = ARENA_REGION_CACHE_MAGAZINE / 2 ? ARENA_REGION_CACHE_MAGAZINE / 2 : 1;
+    while (arena_depot[bucket] && mag->counts[bucket] < want) {
+        Region* reg = arena_depot[bucket];
+        arena_depot[bucket] = reg->next;
+        arena_depot_bytes -= arena_region_bytes(reg);
+        reg->next = mag->regions[bucket];
+        mag->regions[bucket] = reg;
+        mag->counts[bucket]++;
+    }
+    pthread_mutex_unlock(&arena_depot_lock);
+}
+
+// First cached region with at least size words, NULL on a miss.
+static Region* arena_region_cache_take(size_t size)
+{
+    if (sizeof(Region) + size * sizeof(uintptr_t) > ARENA_REGION_CACHE_MAX_REGION) {
+        return NULL;
+    }
+
+    ArenaMagazine* mag = arena_magazine_get();
+    uint32_t bucket = arena_region_bucket((uint32_t)size);
+    // Capacities in the request's own bucket may still be too small, anything
+    // in the next bucket fits.
+    for (uint32_t b = bucket; b <= bucket + 1 && b < ARENA_REGION_CACHE_BUCKETS; b++) {
+        if (!mag->regions[b]) {
+            arena_magazine_refill(mag, b);
+        }
+        Region** link = &mag->regions[b];
+        while (*link) {
+            Region* reg = *link;
+            if (reg->capacity >= size) {
+                *link = reg->next;
+                mag->counts[b]--;
+                return reg;
+            }
+            link = &reg->next;
+        }
+    }
+    return NULL;
+}
+
+// Returns 1 when the cache took ownership of reg.
+static int arena_region_cache_put(Region* reg)
+{
+    if (arena_region_bytes(reg) > ARENA_REGION_CACHE_MAX_REGION || !__atomic_load_n(&arena_depot_limit, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+
+    ArenaMagazine* mag = arena_magazine_get();
+    uint32_t bucket = arena_region_bucket(reg->capacity);
+    if (mag->counts[bucket] == ARENA_REGION_CACHE_MAGAZINE) {
+        arena_magazine_spill(mag, bucket);
+    }
+    reg->next = mag->regions[bucket];
+    mag->regions[bucket] = reg;
+    mag->counts[bucket]++;
+    return 1;
+}
+
+void arena_region_cache_set_limit(size_t bytes)
+{
+    __atomic_store_n(&arena_depot_limit, bytes, __ATOMIC_RELAXED);
+}
+
+size_t arena_region_cache_bytes(void)
+{
+    pthread_mutex_lock(&arena_depot_lock);
+    size_t bytes = arena_depot_bytes;
+    pthread_mutex_unlock(&arena_depot_lock);
+    return bytes;
+}
+
+void arena_region_cache_trim(void)
+{
+    ArenaMagazine* mag = &arena_magazine;
+    Region* lists[ARENA_REGION_CACHE_BUCKETS];
+
+    pthread_mutex_lock(&arena_depot_lock);
+    for (uint32_t b = 0; b < ARENA_REGION_CACHE_BUCKETS; b++) {
+        lists[b] = arena_depot[b];
+        arena_depot[b] = NULL;
+    }
+    arena_depot_bytes = 0;
+    pthread_mutex_unlock(&arena_depot_lock);
+
+    for (uint32_t b = 0; b < ARENA_REGION_CACHE_BUCKETS; b++) {
+        Region* heads[2] = { lists[b], mag->regions[b] };
+        for (int i = 0; i < 2; i++) {
+            Region* reg = heads[i];
+            while (reg) {
+                Region* next = reg->next;
+                free(reg);
+                reg = next;
+            }
+        }
+        mag->regions[b] = NULL;
+        mag->counts[b] = 0;
+    }
+}
+
+#endif // ARENA_REGION_CACHE
+
+#ifdef ARENA_PAGE_MAP
+
+#define ARENA_PAGE_MAP_MASK ((1u << ARENA_PAGE_MAP_BITS) - 1)
+
+// Leaves are mmap'd when first needed, so untouched ranges cost nothing.
+static Region** arena_page_map[1u << ARENA_PAGE_MAP_BITS];
+
+static Region** arena_page_map_leaf(uintptr_t page)
+{
+    Region*** slot = &arena_page_map[(page >> ARENA_PAGE_MAP_BITS) & ARENA_PAGE_MAP_MASK];
+    Region** leaf = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (leaf) {
+        return leaf;
+    }
+    size_t length = sizeof(Region*) << ARENA_PAGE_MAP_BITS;
+    leaf = (Region**)mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (leaf == MAP_FAILED) {
+        printf("Failed to allocate page map leaf\n");
+        return NULL;
+    }
+    Region** expected = NULL;
+    if (!__atomic_compare_exchange_n(slot, &expected, leaf, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        munmap(leaf, length);
+        return expected;
+    }
+    return leaf;
+}
+
+// Points every page of reg at it, or clears the pages still pointing at it.
+static void arena_page_map_set(Region* reg, int present)
+{
+    if (reg->flags & REGION_SHARED) {
+        return;
+    }
+    uintptr_t first = (uintptr_t)reg >> ARENA_PAGE_SHIFT;
+    uintptr_t last = ((uintptr_t)&reg->data[reg->capacity] - 1) >> ARENA_PAGE_SHIFT;
+    for (uintptr_t page = first; page <= last; page++) {
+        if (present) {
+            Region** leaf = arena_page_map_leaf(page);
+            if (leaf) {
+                __atomic_store_n(&leaf[page & ARENA_PAGE_MAP_MASK], reg, __ATOMIC_RELEASE);
+            }
+            continue;
+        }
+        Region** leaf = __atomic_load_n(&arena_page_map[(page >> ARENA_PAGE_MAP_BITS) & ARENA_PAGE_MAP_MASK], __ATOMIC_ACQUIRE);
+        if (leaf) {
+            Region* expected = reg;
+            __atomic_compare_exchange_n(&leaf[page & ARENA_PAGE_MAP_MASK], &expected, NULL, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void* arena_region_malloc(size_t size)
+{
+    void* mem = NULL;
+    return posix_memalign(&mem, 1u << ARENA_PAGE_SHIFT, ARENA_PAGE_ALIGN(size)) == 0 ? mem : NULL;
+}
+
+Region* arena_region_of(const void* ptr)
+{
+    uintptr_t page = (uintptr_t)ptr >> ARENA_PAGE_SHIFT;
+    Region** leaf = __atomic_load_n(&arena_page_map[(page >> ARENA_PAGE_MAP_BITS) & ARENA_PAGE_MAP_MASK], __ATOMIC_ACQUIRE);
+    if (!leaf) {
+        return NULL;
+    }
+    Region* reg = __atomic_load_n(&leaf[page & ARENA_PAGE_MAP_MASK], __ATOMIC_ACQUIRE);
+    if (!reg || (const char*)ptr < (const char*)reg->data || (const char*)ptr >= (const char*)&reg->data[reg->capacity]) {
+        return NULL;
+    }
+    return reg;
+}
+
+int arena_owns(Arena* arena, const void* ptr)
+{
+    Region* reg = arena_region_of(ptr);
+    return reg && reg->arena == arena;
+}
+
+#define ARENA_PAGE_MAP_ADD(reg) arena_page_map_set(reg, 1)
+#define ARENA_PAGE_MAP_REMOVE(reg) arena_page_map_set(reg, 0)
+#define ARENA_SET_OWNER(reg, owner) ((reg)->arena = (owner))
+#define ARENA_REGION_MALLOC(size) arena_region_malloc(size)
+#else
+#define ARENA_PAGE_MAP_ADD(reg)
+#define ARENA_PAGE_MAP_REMOVE(reg)
+#define ARENA_SET_OWNER(reg, owner)
+#define ARENA_REGION_MALLOC(size) malloc(size)
+#endif // ARENA_PAGE_MAP
+
+// Anonymous shared memory file, falling back to an unlinked shm object.
+static int arena_memfd(const char* name)
+{
+#ifdef SYS_memfd_create
+    int fd = (int)syscall(SYS_memfd_create, name, 0);
+    if (fd >= 0) {
+        return fd;
+    }
+#endif
+    char path[64];
+    snprintf(path, sizeof(path), "/%s-%ld-%p", name, (long)getpid(), (void*)&path);
+    int shm = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (shm >= 0) {
+        shm_unlink(path);
+    }
+    return shm;
+}
+
+// Header of an empty region of capacity words placed at mem.
+static Region* region_init(void* mem, size_t capacity, uint32_t flags, int32_t fd)
+{
+    Region* region = (Region*)mem;
+    region->data_count = 0;
+    region->capacity = (uint32_t)capacity;
+    region->next = NULL;
+    region->flags = flags;
+    region->fd = fd;
+    // Fresh mappings come zeroed, heap memory may hold anything.
+    region->zero_mark = flags & (REGION_MAPPED | REGION_MEMFD | REGION_RESERVED) ? 0 : (uint32_t)capacity;
+    region->arena = NULL;
+    ARENA_POISON(region->data, capacity * sizeof(uintptr_t));
+    ARENA_PAGE_MAP_ADD(region);
+    return region;
+}
+
+// Call before data_count goes down: everything below it may have been written.
+static inline void region_raise_zero_mark(Region* reg)
+{
+    if (reg->data_count > reg->zero_mark) {
+        reg->zero_mark = reg->data_count;
+    }
+}
+
+// Zeroes with non-temporal stores, so the memory is not pulled into the cache.
+static void arena_stream_zero(void* dst, size_t bytes)
+{
+    char* p = (char*)dst;
+#if defined(__AVX512F__) || defined(__AVX2__) || defined(__SSE2__)
+    size_t head = (size_t)(-(uintptr_t)p & 63);
+    if (head > bytes) {
+        head = bytes;
+    }
+    memset(p, 0, head);
+    p += head;
+    bytes -= head;
+#if defined(__AVX512F__)
+    __m512i zero = _mm512_setzero_si512();
+    for (; bytes >= 64; p += 64, bytes -= 64) {
+        _mm512_stream_si512((__m512i*)p, zero);
+    }
+#elif defined(__AVX2__)
+    __m256i zero = _mm256_setzero_si256();
+    for (; bytes >= 64; p += 64, bytes -= 64) {
+        _mm256_stream_si256((__m256i*)p, zero);
+        _mm256_stream_si256((__m256i*)(p + 32), zero);
+    }
+#else
+    __m128i zero = _mm_setzero_si128();
+    for (; bytes >= 64; p += 64, bytes -= 64) {
+        _mm_stream_si128((__m128i*)p, zero);
+        _mm_stream_si128((__m128i*)(p + 16), zero);
+        _mm_stream_si128((__m128i*)(p + 32), zero);
+        _mm_stream_si128((__m128i*)(p + 48), zero);
+    }
+#endif
+    _mm_sfence();
+#endif
+    memset(p, 0, bytes);
+}
+
+// memset is already vectorized, big blocks bypass the cache instead so
+// clearing them does not evict everything else.
+static void arena_zero(void* dst, size_t bytes)
+{
+    if (bytes >= ARENA_STREAM_THRESHOLD) {
+        arena_stream_zero(dst, bytes);
+        return;
+    }
+    memset(dst, 0, bytes);
+}
+
+// Zeroing that survives optimization even when the memory is never read again.
+static void arena_wipe(void* dst, size_t bytes)
+{
+    arena_stream_zero(dst, bytes);
+    __asm__ __volatile__("" : : "r"(dst) : "memory");
+}
+
+// Wipes everything handed out past keep and gives it back, now known zero.
+static void region_scrub(Region* reg, uint32_t keep)
+{
+    if (reg->data_count <= keep) {
+        return;
+    }
+    size_t bytes = (reg->data_count - keep) * sizeof(uintptr_t);
+    ARENA_UNPOISON(&reg->data[keep], bytes);
+    arena_wipe(&reg->data[keep], bytes);
+    ARENA_POISON(&reg->data[keep], bytes);
+    if (reg->zero_mark <= reg->data_count && reg->zero_mark > keep) {
+        reg->zero_mark = keep;
+    }
+    reg->data_count = keep;
+}
+
+Region* create_region(uint32_t size_bytes)
+{
+    size_t size = ALIGN_SIZE(size_bytes);
+
+#ifdef ARENA_REGION_CACHE
+    // A cached region may be bigger than asked for, keep all of it usable.
+    Region* region = arena_region_cache_take(size);
+    if (region) {
+        size = region->capacity;
+    } else {
+        region = (Region*)ARENA_REGION_MALLOC(sizeof(Region) + size * sizeof(uintptr_t));
+    }
+#else
+    Region* region = (Region*)ARENA_REGION_MALLOC(sizeof(Region) + size * sizeof(uintptr_t));
+#endif
+
+    if (!region) {
+        printf("Failed to allocate region: (%lu bytes)\n", sizeof(Region) + size * sizeof(uintptr_t));
+        return NULL;
+    }
+    return region_init(region, size, REGION_MALLOC, -1);
+};
+
+Region* create_region_memfd(uint32_t size_bytes)
+{
+    size_t size = ALIGN_SIZE(size_bytes);
+    size_t length = sizeof(Region) + size * sizeof(uintptr_t);
+
+    int fd = arena_memfd("stam-region");
+    void* map = MAP_FAILED;
+    if (fd >= 0 && ftruncate(fd, (off_t)length) == 0) {
+        map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        printf("Failed to allocate memfd region: (%zu bytes)\n", length);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return NULL;
+    }
+
+    return region_init(map, size, REGION_MEMFD, fd);
+}
+
+Region* create_region_mapped(uint32_t size_bytes)
+{
+    size_t size = ALIGN_SIZE(size_bytes);
+    size_t length = sizeof(Region) + size * sizeof(uintptr_t);
+
+    void* map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        printf("Failed to allocate mapped region: (%zu bytes)\n", length);
+        return NULL;
+    }
+
+    return region_init(map, size, REGION_MAPPED, -1);
+}
+
+void* region_allocate(Region* reg, uint32_t size_bytes)
+{
+
+    size_t size = ALIGN_SIZE(size_bytes) + ARENA_REDZONE_WORDS;
+
+    if (reg->data_count + size > reg->capacity) {
+        printf("Tried to region_allocate size (%" PRIu64 ") greater than capacity (%" PRIu32 ")\n", reg->data_count + size, reg->capacity);
+        return NULL;
+    }
+
+    void* res = &reg->data[reg->data_count + ARENA_REDZONE_WORDS];
+    reg->data_count += size;
+    ARENA_UNPOISON(res, size_bytes);
+
+    return res;
+}
+
+#ifdef ARENA_DEBUG
+// Pattern-fill and poison everything past word `keep` that was handed out.
+static void region_release_debug(Region* reg, uint32_t keep)
+{
+    if (reg->data_count > keep) {
+        size_t bytes = (reg->data_count - keep) * sizeof(uintptr_t);
+        ARENA_UNPOISON(&reg->data[keep], bytes);
+        memset(&reg->data[keep], ARENA_RESET_PATTERN, bytes);
+        ARENA_POISON(&reg->data[keep], bytes);
+    }
+}
+#define ARENA_RELEASE_DEBUG(reg, keep) region_release_debug(reg, keep)
+#else
+#define ARENA_RELEASE_DEBUG(reg, keep)
+#endif
+
+inline void region_reset(Region* reg)
+{
+    ARENA_RELEASE_DEBUG(reg, 0);
+    region_raise_zero_mark(reg);
+    reg->data_count = 0;
+}
+inline void region_free(Region* reg)
+{
+    ARENA_PAGE_MAP_REMOVE(reg);
+#ifdef ARENA_REGION_CACHE
+    if (reg->flags == REGION_MALLOC && arena_region_cache_put(reg)) {
+        ARENA_POISON(reg->data, reg->capacity * sizeof(uintptr_t));
+        return;
+    }
+#endif
+    ARENA_UNPOISON(reg->data, reg->capacity * sizeof(uintptr_t));
+    if (reg->flags & REGION_MAPPED) {
+        munmap(reg, sizeof(Region) + reg->capacity * sizeof(uintptr_t));
+        return;
+    }
+    if (reg->flags & REGION_MEMFD) {
+        int fd = reg->fd;
+        munmap(reg, sizeof(Region) + reg->capacity * sizeof(uintptr_t));
+        close(fd);
+        return;
+    }
+    if (reg->flags & (REGION_EXTERNAL | REGION_RESERVED)) {
+        return;
+    }
+    if (reg->flags & REGION_HEADER_BLOCK) {
+        free((char*)reg - ARENA_HEADER_BYTES);
+        return;
+    }
+    if (reg->flags & REGION_SHARED) {
+        ArenaSharedHeader* header = (ArenaSharedHeader*)reg - 1;
+        munmap(header, header->length);
+        return;
+    }
+    free(reg);
+}
+
+void print_region(Region* reg)
+{
+    if (!reg) {
+        printf("Region is null, could not print.");
+        return;
+    }
+    printf("Used: %" PRIu64 " bytes\n", reg->data_count * sizeof(uintptr_t));
+    printf("Capacity: %" PRIu64 " bytes\n", reg->capacity * sizeof(uintptr_t));
+}
+
+// Defaults for every way of making an arena, callers fill in the regions.
+static void arena_init_header(Arena* arena)
+{
+    arena->start = NULL;
+    arena->end = NULL;
+    arena->last = NULL;
+    arena->growth = ARENA_GROWTH_FIXED;
+    arena->region_size = 0;
+    arena->region_flags = REGION_MALLOC;
+    arena->parent = NULL;
+    arena->pool = NULL;
+    arena->borrowed_regions = 0;
+    arena->lent_regions = 0;
+    arena->header_flags = ARENA_HEADER_MALLOC;
+    arena->backfill = 0;
+    arena->secure = ARENA_SECURE_OFF;
+    memset(arena->tails, 0, sizeof(arena->tails));
+    arena->reserve = NULL;
+    arena->reserve_size = 0;
+    arena->reserve_used = 0;
+}
+
+// Next size words of the reservation as a region, NULL once it is used up.
+static Region* arena_reserve_region(Arena* arena, size_t size)
+{
+    uint64_t length = sizeof(Region) + size * sizeof(uintptr_t);
+    if (arena->reserve_size - arena->reserve_used < length) {
+        printf("Arena reservation is full: (%" PRIu64 " of %" PRIu64 " bytes used)\n",
+            arena->reserve_used, arena->reserve_size);
+        return NULL;
+    }
+    Region* reg = region_init(arena->reserve + arena->reserve_used, size, REGION_RESERVED, -1);
+    arena->reserve_used += length;
+#ifdef ARENA_PAGE_MAP
+    arena->reserve_used = ARENA_PAGE_ALIGN(arena->reserve_used);
+#endif
+    return reg;
+}
+
+// Slow path of a full arena: reuse an idle region of at least size words,
+// borrow one from the parent or make a new one.
+static Region* arena_new_region(Arena* arena, size_t size)
+{
+    for (Region** link = &arena->pool; *link; link = &(*link)->next) {
+        if ((*link)->capacity >= size) {
+            Region* reg = *link;
+            *link = reg->next;
+            reg->next = NULL;
+            return reg;
+        }
+    }
+
+    if (arena->parent) {
+        Region* reg = arena_new_region(arena->parent, size);
+        if (reg) {
+            arena->parent->lent_regions += 1;
+            arena->borrowed_regions += 1;
+        }
+        return reg;
+    }
+
+    if (arena->reserve_size) {
+        return arena_reserve_region(arena, size);
+    }
+
+    uint32_t size_bytes = (uint32_t)(size * sizeof(uintptr_t));
+    if (arena->region_flags & REGION_MEMFD) {
+        return create_region_memfd(size_bytes);
+    }
+    if (arena->region_flags & REGION_MAPPED) {
+        return create_region_mapped(size_bytes);
+    }
+    return create_region(size_bytes);
+}
+
+#ifdef ARENA_SCRUB_THREAD
+#include <pthread.h>
+
+static pthread_mutex_t arena_scrub_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t arena_scrub_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t arena_scrub_idle = PTHREAD_COND_INITIALIZER;
+static pthread_once_t arena_scrub_once = PTHREAD_ONCE_INIT;
+static Region* arena_scrub_queue = NULL;
+static int arena_scrub_busy = 0;
+static int arena_scrub_running = 0;
+
+static void* arena_scrub_main(void* unused)
+{
+    (void)unused;
+    pthread_mutex_lock(&arena_scrub_lock);
+    for (;;) {
+        while (!arena_scrub_queue) {
+            arena_scrub_busy = 0;
+            pthread_cond_broadcast(&arena_scrub_idle);
+            pthread_cond_wait(&arena_scrub_work, &arena_scrub_lock);
+        }
+        Region* list = arena_scrub_queue;
+        arena_scrub_queue = NULL;
+        arena_scrub_busy = 1;
+        pthread_mutex_unlock(&arena_scrub_lock);
+
+        while (list) {
+            Region* next = list->next;
+            region_scrub(list, 0);
+            region_free(list);
+            list = next;
+        }
+        pthread_mutex_lock(&arena_scrub_lock);
+    }
+    return NULL;
+}
+
+static void arena_scrub_start(void)
+{
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, arena_scrub_main, NULL) == 0) {
+        pthread_detach(thread);
+        arena_scrub_running = 1;
+    }
+}
+
+// Queues reg for the scrubber, returns 0 if there is no scrubber to take it.
+static int arena_scrub_defer(Region* reg)
+{
+    pthread_once(&arena_scrub_once, arena_scrub_start);
+    if (!arena_scrub_running) {
+        return 0;
+    }
+    // No arena's memory any more, even before the scrubber gets to it.
+    ARENA_PAGE_MAP_REMOVE(reg);
+    pthread_mutex_lock(&arena_scrub_lock);
+    reg->next = arena_scrub_queue;
+    arena_scrub_queue = reg;
+    arena_scrub_busy = 1;
+    pthread_cond_signal(&arena_scrub_work);
+    pthread_mutex_unlock(&arena_scrub_lock);
+    return 1;
+}
+
+void arena_scrub_wait(void)
+{
+    pthread_mutex_lock(&arena_scrub_lock);
+    while (arena_scrub_queue || arena_scrub_busy) {
+        pthread_cond_wait(&arena_scrub_idle, &arena_scrub_lock);
+    }
+    pthread_mutex_unlock(&arena_scrub_lock);
+}
+#else
+static inline int arena_scrub_defer(Region* reg)
+{
+    (void)reg;
+    return 0;
+}
+#endif
+
+// Gives a region the arena no longer uses back to whoever it came from.
+static void arena_release_region(Arena* arena, Region* reg)
+{
+    if (!arena->parent && (reg->flags & (REGION_RESERVED | REGION_EXTERNAL))) {
+        // Goes back with the reservation or header it sits in, keep it for growth.
+        if (arena->secure) {
+            region_scrub(reg, 0);
+        } else {
+            region_reset(reg);
+        }
+        reg->next = arena->pool;
+        arena->pool = reg;
+        return;
+    }
+    if (!arena->parent) {
+        if (arena->secure) {
+            if (arena->secure == ARENA_SECURE_DEFERRED && !(reg->flags & REGION_EXTERNAL) && arena_scrub_defer(reg)) {
+                return;
+            }
+            region_scrub(reg, 0);
+        }
+        region_free(reg);
+        return;
+    }
+    if (arena->secure) {
+        region_scrub(reg, 0);
+    } else {
+        region_reset(reg);
+    }
+    reg->next = arena->parent->pool;
+    arena->parent->pool = reg;
+    ARENA_SET_OWNER(reg, arena->parent);
+    arena->parent->lent_regions -= 1;
+    arena->borrowed_regions -= 1;
+}
+
+Arena* arena_create_child(Arena* parent, uint32_t size_bytes)
+{
+    ArenaMark before = arena_scratch(parent);
+    Arena* child = (Arena*)arena_allocate(parent, sizeof(Arena));
+    if (!child) {
+        return NULL;
+    }
+    arena_init_header(child);
+    child->growth = parent->growth == ARENA_GROWTH_NONE ? ARENA_GROWTH_FIXED : parent->growth;
+    child->parent = parent;
+    child->header_flags = ARENA_HEADER_EXTERNAL;
+    child->secure = parent->secure;
+    child->reserve = parent->reserve;
+
+    child->start = arena_new_region(child, ALIGN_SIZE(size_bytes));
+    if (!child->start) {
+        printf("Failed to borrow a region for child arena\n");
+        // The header was the parent's last allocation, hand it back.
+        arena_pop_scratch(parent, before);
+        return NULL;
+    }
+    ARENA_SET_OWNER(child->start, child);
+    child->end = child->start;
+    child->last = child->start;
+
+    ARENA_TRACE_EVENT(ARENA_TRACE_CREATE, child, size_bytes);
+    return child;
+}
+
+// The header and the first region share one block, the region marked
+// external so only arena_free's final free releases it. With the region cache
+// the first region comes from the cache instead and the header is malloc'd on
+// its own, so create_arena and arena_free churn keeps reusing regions.
+Arena* create_arena(uint32_t size_bytes)
+{
+#ifdef ARENA_REGION_CACHE
+    Arena* arena = (Arena*)malloc(sizeof(Arena));
+    if (!arena) {
+        printf("Failed to allocate arena: (%zu bytes)\n", sizeof(Arena));
+        return NULL;
+    }
+    if (arena_init(arena, size_bytes) != 0) {
+        free(arena);
+        return NULL;
+    }
+    arena->header_flags = ARENA_HEADER_MALLOC;
+    return arena;
+#else
+    size_t size = ALIGN_SIZE(size_bytes);
+    size_t header = ARENA_HEADER_BYTES;
+    char* block = (char*)ARENA_REGION_MALLOC(header + sizeof(Region) + size * sizeof(uintptr_t));
+    if (!block) {
+        printf("Failed to allocate arena: (%zu bytes)\n", header + sizeof(Region) + size * sizeof(uintptr_t));
+        return NULL;
+    }
+
+    Arena* arena = (Arena*)block;
+    arena_init_header(arena);
+    arena->header_flags = ARENA_HEADER_WITH_REGION;
+    arena->start = region_init(block + header, size, REGION_EXTERNAL, -1);
+    arena->end = arena->start;
+    arena->last = arena->start;
+    ARENA_SET_OWNER(arena->start, arena);
+
+    ARENA_TRACE_EVENT(ARENA_TRACE_CREATE, arena, size_bytes);
+    return arena;
+#endif
+};
+
+int arena_init(Arena* arena, uint32_t size_bytes)
+{
+    arena_init_header(arena);
+    arena->header_flags = ARENA_HEADER_EXTERNAL;
+    arena->start = create_region(size_bytes);
+    if (!arena->start) {
+        return -1;
+    }
+    arena->end = arena->start;
+    arena->last = arena->start;
+    ARENA_SET_OWNER(arena->start, arena);
+
+    ARENA_TRACE_EVENT(ARENA_TRACE_CREATE, arena, size_bytes);
+    return 0;
+}
+
+int arena_init_from_buffer(Arena* arena, void* buf, size_t size_bytes)
+{
+    uintptr_t start = ((uintptr_t)buf + sizeof(uintptr_t) - 1) & ~(uintptr_t)(sizeof(uintptr_t) - 1);
+    uintptr_t end = (uintptr_t)buf + size_bytes;
+
+    arena_init_header(arena);
+    arena->header_flags = ARENA_HEADER_BUFFER;
+    if (end < start + sizeof(Region) + sizeof(uintptr_t)) {
+        printf("Buffer too small for an arena region: (%zu bytes)\n", size_bytes);
+        return -1;
+    }
+
+    size_t capacity = (end - start - sizeof(Region)) / sizeof(uintptr_t);
+    arena->start = region_init((void*)start, capacity > UINT32_MAX ? UINT32_MAX : capacity, REGION_EXTERNAL, -1);
+    arena->end = arena->start;
+    arena->last = arena->start;
+    ARENA_SET_OWNER(arena->start, arena);
+
+    ARENA_TRACE_EVENT(ARENA_TRACE_CREATE, arena, (uint32_t)size_bytes);
+    return 0;
+}
+
+Arena* create_forkable_arena(uint32_t size_bytes)
+{
+    Arena* arena = (Arena*)malloc(sizeof(Arena));
+    if (!arena) {
+        printf("Failed to allocate forkable arena: (%zu bytes)\n", sizeof(Arena));
+        return NULL;
+    }
+
+    arena_init_header(arena);
+    arena->start = create_region_memfd(size_bytes);
+    if (!arena->start) {
+        free(arena);
+        return NULL;
+    }
+    arena->end = arena->start;
+    arena->last = arena->start;
+    ARENA_SET_OWNER(arena->start, arena);
+    arena->region_flags = REGION_MEMFD;
+
+    ARENA_TRACE_EVENT(ARENA_TRACE_CREATE, arena, size_bytes);
+    return arena;
+}
+
+Arena* create_mapped_arena(uint32_t size_bytes)
+{
+    Arena* arena = (Arena*)malloc(sizeof(Arena));
+    if (!arena) {
+        printf("Failed to allocate mapped arena: (%zu bytes)\n", sizeof(Arena));
+        return NULL;
+    }
+
+    arena_init_header(arena);
+    arena->start = create_region_mapped(size_bytes);
+    if (!arena->start) {
+        free(arena);
+        return NULL;
+    }
+    arena->end = arena->start;
+    arena->last = arena->start;
+    ARENA_SET_OWNER(arena->start, arena);
+    arena->region_flags = REGION_MAPPED;
+
+    ARENA_TRACE_EVENT(ARENA_TRACE_CREATE, arena, size_bytes);
+    return arena;
+}
+
+Arena* create_reserved_arena(uint64_t reserve_bytes, uint32_t size_bytes)
+{
+    uint64_t length = ARENA_PAGE_ALIGN(reserve_bytes);
+    size_t header = ARENA_HEADER_BYTES;
+    if (length > ARENA_RESERVE_MAX) {
+        printf("Reservation too big for 32-bit offsets: (%" PRIu64 " bytes)\n", reserve_bytes);
+        return NULL;
+    }
+    if (length < header + sizeof(Region) + ALIGN_SIZE(size_bytes) * sizeof(uintptr_t)) {
+        printf("Reservation too small for the first region: (%" PRIu64 " bytes)\n", reserve_bytes);
+        return NULL;
+    }
+
+    void* map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED) {
+        printf("Failed to reserve arena: (%" PRIu64 " bytes)\n", length);
+        return NULL;
+    }
+
+    Arena* arena = (Arena*)map;
+    arena_init_header(arena);
+    arena->header_flags = ARENA_HEADER_RESERVED;
+    arena->reserve = (char*)map;
+    arena->reserve_size = length;
+    arena->reserve_used = header;
+    arena->start = arena_reserve_region(arena, ALIGN_SIZE(size_bytes));
+    arena->end = arena->start;
+    arena->last = arena->start;
+    ARENA_SET_OWNER(arena->start, arena);
+
+    ARENA_TRACE_EVENT(ARENA_TRACE_CREATE, arena, size_bytes);
+    return arena;
+}
+
+Arena* arena_fork(Arena* arena)
+{
+    Arena* child = (Arena*)malloc(sizeof(Arena));
+    if (!child) {
+        return NULL;
+    }
+    arena_init_header(child);
+    child->growth = arena->growth == ARENA_GROWTH_NONE ? ARENA_GROWTH_FIXED : arena->growth;
+
+    Region* prev = NULL;
+    for (Region* curr = arena->start; curr; curr = curr->next) {
+        if (!(curr->flags & REGION_MEMFD)) {
+            printf("Only arenas made with create_forkable_arena can be forked\n");
+            arena_free(child);
+            return NULL;
+        }
+        size_t length = sizeof(Region) + curr->capacity * sizeof(uintptr_t);
+        void* map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, curr->fd, 0);
+        if (map == MAP_FAILED) {
+            printf("Failed to map region for arena fork: (%zu bytes)\n", length);
+            arena_free(child);
+            return NULL;
+        }
+
+        // Everything the parent has not used yet stays the parent's, the
+        // child's own regions are sized like the parent's.
+        Region* reg = (Region*)map;
+        if (curr->capacity > child->region_size) {
+            child->region_size = curr->capacity;
+        }
+        reg->capacity = reg->data_count;
+        reg->next = NULL;
+        reg->flags = REGION_MAPPED;
+        reg->fd = -1;
+        ARENA_SET_OWNER(reg, child);
+        ARENA_PAGE_MAP_ADD(reg);
+        size_t used = ARENA_PAGE_ALIGN(sizeof(Region) + reg->capacity * sizeof(uintptr_t));
+        if (used < length) {
+            munmap((char*)map + used, length - used);
+        }
+
+        if (prev) {
+            prev->next = reg;
+        } else {
+            child->start = reg;
+        }
+        prev = reg;
+        if (curr == arena->end) {
+            break;
+        }
+    }
+    child->end = prev;
+    child->last = prev;
+
+    // Traced with the size its new regions get, like any other create.
+    ARENA_TRACE_EVENT(ARENA_TRACE_CREATE, child,
+        child->region_size < UINT32_MAX / sizeof(uintptr_t) ? child->region_size * (uint32_t)sizeof(uintptr_t) : UINT32_MAX);
+    return child;
+}
+
+static inline uint32_t arena_tail_class(size_t words)
+{
+    uint32_t log = 63 - (uint32_t)__builtin_clzll((unsigned long long)words);
+    return log < ARENA_TAIL_CLASSES ? log : ARENA_TAIL_CLASSES - 1;
+}
+
+// Keeps the larger of reg's free space and what its class already holds.
+static void arena_remember_tail(Arena* arena, Region* reg)
+{
+    size_t free_words = reg->capacity - reg->data_count;
+    if (free_words == 0) {
+        return;
+    }
+    Region** slot = &arena->tails[arena_tail_class(free_words)];
+    if (!*slot || (size_t)((*slot)->capacity - (*slot)->data_count) < free_words) {
+        *slot = reg;
+    }
+}
+
+// A remembered tail with room for size words, taken out of the table.
+static Region* arena_take_tail(Arena* arena, size_t size)
+{
+    for (uint32_t k = arena_tail_class(size); k < ARENA_TAIL_CLASSES; k++) {
+        Region* reg = arena->tails[k];
+        if (reg && reg->capacity - reg->data_count >= size) {
+            arena->tails[k] = NULL;
+            return reg;
+        }
+    }
+    return NULL;
+}
+
+// arena_allocate, also telling the caller which region the memory is in.
+static inline void* arena_allocate_from(Arena* arena, uint32_t size_bytes, Region** from)
+{
+    Region* curr = arena->end;
+
+    size_t size = ALIGN_SIZE(size_bytes) + ARENA_REDZONE_WORDS;
+
+    if (arena->backfill && curr->capacity - curr->data_count < size && size) {
+        Region* tail = arena_take_tail(arena, size);
+        if (tail) {
+            void* res = region_allocate(tail, size_bytes);
+            arena_remember_tail(arena, tail);
+            *from = tail;
+            return res;
+        }
+    }
+
+    while (curr->capacity - curr->data_count < size) {
+        if (arena->backfill) {
+            arena_remember_tail(arena, curr);
+        }
+        if (curr->next == NULL) {
+            if (arena->growth == ARENA_GROWTH_NONE) {
+                printf("Arena is out of space and may not grow: (%" PRIu32 " bytes)\n", size_bytes);
+                return NULL;
+            }
+            uint32_t new_size = curr->capacity > arena->region_size ? curr->capacity : arena->region_size;
+            if (arena->growth == ARENA_GROWTH_DOUBLE && new_size <= UINT32_MAX / (2 * sizeof(uintptr_t))) {
+                new_size *= 2;
+            }
+            if (size > new_size) {
+                new_size = size;
+            }
+            curr->next = arena_new_region(arena, new_size);
+            if (!curr->next) {
+                printf("Failed to allocate new region for arena\n");
+                return NULL;
+            }
+            ARENA_SET_OWNER(curr->next, arena);
+            arena->last = curr->next;
+        }
+        curr = curr->next;
+    }
+    arena->end = curr;
+    *from = curr;
+    return region_allocate(arena->end, size_bytes);
+}
+
+void* arena_allocate(Arena* arena, uint32_t size_bytes)
+{
+    ARENA_TRACE_EVENT(ARENA_TRACE_ALLOC, arena, size_bytes);
+
+    Region* reg;
+    return arena_allocate_from(arena, size_bytes, &reg);
+}
+
+int arena_allocate_batch(Arena* arena, const size_t* sizes, size_t n, void** out)
+{
+    if (n == 0) {
+        return 0;
+    }
+    // The block brings the first redzone, the rest sit between elements. The
+    // total is checked as it grows, so neither a huge size nor a long list wraps.
+    uint64_t words = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (sizes[i] > UINT32_MAX) {
+            printf("arena_allocate_batch size overflows: (%zu bytes)\n", sizes[i]);
+            return -1;
+        }
+        words += ALIGN_SIZE((uint64_t)sizes[i]) + (i > 0 ? ARENA_REDZONE_WORDS : 0);
+        if (words * sizeof(uintptr_t) > UINT32_MAX) {
+            printf("arena_allocate_batch size overflows: (%" PRIu64 " words)\n", words);
+            return -1;
+        }
+    }
+    uint32_t total = (uint32_t)(words * sizeof(uintptr_t));
+    ARENA_TRACE_EVENT(ARENA_TRACE_ALLOC, arena, total);
+
+    Region* reg;
+    uintptr_t* block = (uintptr_t*)arena_allocate_from(arena, total, &reg);
+    if (!block) {
+        return -1;
+    }
+    ARENA_POISON(block, total);
+    for (size_t i = 0; i < n; i++) {
+        out[i] = block;
+        ARENA_UNPOISON(block, sizes[i]);
+        block += ALIGN_SIZE(sizes[i]) + ARENA_REDZONE_WORDS;
+    }
+    return 0;
+}
+
+void* arena_calloc(Arena* arena, uint32_t count, uint32_t size_bytes)
+{
+    uint64_t total = (uint64_t)count * size_bytes;
+    if (total > UINT32_MAX) {
+        printf("arena_calloc size overflows: (%" PRIu32 " x %" PRIu32 " bytes)\n", count, size_bytes);
+        return NULL;
+    }
+    ARENA_TRACE_EVENT(ARENA_TRACE_ALLOC, arena, (uint32_t)total);
+
+    Region* reg;
+    char* res = (char*)arena_allocate_from(arena, (uint32_t)total, &reg);
+    if (!res) {
+        return NULL;
+    }
+
+    // Memory is handed out upwards, so only the part below zero_mark was used.
+    char* zero_start = (char*)&reg->data[reg->zero_mark];
+    size_t dirty = res < zero_start ? (size_t)(zero_start - res) : 0;
+    if (dirty) {
+        arena_zero(res, dirty < total ? dirty : (size_t)total);
+    }
+    // Reading a fresh page before writing it costs a zero page fault and then a
+    // copy-on-write fault. Small blocks are likely read first, so their clean
+    // pages get one zero store each, which commits them with a single fault.
+    if (total <= ARENA_CALLOC_EAGER_BYTES && dirty < total) {
+        for (char* p = res + dirty; p < res + total; p += 4096 - ((uintptr_t)p & 4095)) {
+            *(volatile char*)p = 0;
+        }
+    }
+    return res;
+}
+
+ArenaMark arena_scratch(Arena* arena)
+{
+    ArenaMark mark = { NULL, 0 };
+    if (arena->end == NULL) {
+        printf("Tried to make a scrach arena for an uninitialized arena");
+        return mark;
+    }
+    mark.reg = arena->end;
+    mark.count = arena->end->data_count;
+
+    return mark;
+}
+void arena_pop_scratch(Arena* arena, ArenaMark m)
+{
+    if (m.reg == NULL) {
+        arena_reset(arena);
+        return;
+    }
+    if (arena->secure) {
+        region_scrub(m.reg, m.count);
+    } else {
+        ARENA_RELEASE_DEBUG(m.reg, m.count);
+        region_raise_zero_mark(m.reg);
+        m.reg->data_count = m.count;
+    }
+    memset(arena->tails, 0, sizeof(arena->tails));
+    Region* curr = m.reg->next;
+    while (curr) {
+        if (arena->secure) {
+            region_scrub(curr, 0);
+        } else {
+            region_reset(curr);
+        }
+        curr = curr->next;
+    }
+    arena->end = m.reg;
+}
+
+void arena_reset(Arena* arena)
+{
+    ARENA_TRACE_EVENT(ARENA_TRACE_RESET, arena, 0);
+
+    if (arena->parent || arena->secure == ARENA_SECURE_DEFERRED) {
+        // Children keep their first region and return the rest, deferred
+        // secure arenas hand the rest to the scrubber.
+        Region* curr = arena->start->next;
+        while (curr) {
+            Region* tmp = curr->next;
+            arena_release_region(arena, curr);
+            curr = tmp;
+        }
+        arena->start->next = NULL;
+        arena->last = arena->start;
+    }
+
+    Region* curr = arena->start;
+    while (curr) {
+        if (arena->secure) {
+            region_scrub(curr, 0);
+        } else {
+            region_reset(curr);
+        }
+        curr = curr->next;
+    }
+    arena->end = arena->start;
+    memset(arena->tails, 0, sizeof(arena->tails));
+}
+
+void arena_reset_secure(Arena* arena)
+{
+    ArenaSecure secure = arena->secure;
+    if (secure == ARENA_SECURE_OFF) {
+        arena->secure = ARENA_SECURE_SYNC;
+    }
+    arena_reset(arena);
+    arena->secure = secure;
+}
+
+void arena_set_secure(Arena* arena, ArenaSecure secure)
+{
+#ifndef ARENA_SCRUB_THREAD
+    if (secure == ARENA_SECURE_DEFERRED) {
+        secure = ARENA_SECURE_SYNC;
+    }
+#endif
+    arena->secure = secure;
+}
+
+void arena_reset_zeroed(Arena* arena)
+{
+    arena_reset(arena);
+    for (Region* curr = arena->start; curr; curr = curr->next) {
+        size_t used = curr->zero_mark < curr->capacity ? curr->zero_mark : curr->capacity;
+        ARENA_UNPOISON(curr->data, used * sizeof(uintptr_t));
+        arena_zero(curr->data, used * sizeof(uintptr_t));
+        ARENA_POISON(curr->data, used * sizeof(uintptr_t));
+        curr->zero_mark = 0;
+    }
+}
+
+void arena_free(Arena* arena)
+{
+    ARENA_TRACE_EVENT(ARENA_TRACE_FREE, arena, 0);
+
+    Region* lists[2] = { arena->start, arena->pool };
+#ifdef ARENA_PAGE_MAP
+    // These die with the header, buffer or reservation, not in region_free.
+    for (int i = 0; i < 2 && !arena->parent; i++) {
+        for (Region* reg = lists[i]; reg; reg = reg->next) {
+            if (reg->flags & (REGION_EXTERNAL | REGION_RESERVED)) {
+                ARENA_PAGE_MAP_REMOVE(reg);
+            }
+        }
+    }
+#endif
+    for (int i = 0; i < 2; i++) {
+        Region* curr = lists[i];
+        while (curr) {
+            Region* tmp = curr->next;
+            arena_release_region(arena, curr);
+            curr = tmp;
+        }
+    }
+
+    // A child's header is part of its parent and goes away with it.
+    if (arena->header_flags == ARENA_HEADER_RESERVED) {
+        munmap(arena->reserve, arena->reserve_size);
+    } else if (arena->header_flags == ARENA_HEADER_MALLOC || arena->header_flags == ARENA_HEADER_WITH_REGION) {
+        free(arena);
+    }
+}
+
+int arena_merge(Arena* dst, Arena* src)
+{
+    if (dst == src || dst->parent || src->parent || src->lent_regions) {
+        printf("Cannot merge child arenas or arenas with children\n");
+        return -1;
+    }
+    if (dst->reserve || src->reserve || src->header_flags == ARENA_HEADER_BUFFER
+        || (dst->start->flags | src->start->flags) & REGION_SHARED) {
+        printf("Cannot merge reserved, shared or buffer-backed arenas\n");
+        return -1;
+    }
+    // dst would give src's memory back without wiping it.
+    if (src->secure != ARENA_SECURE_OFF && dst->secure == ARENA_SECURE_OFF) {
+        printf("Cannot merge a secure arena into one that is not\n");
+        return -1;
+    }
+
+    ARENA_TRACE_EVENT(ARENA_TRACE_FREE, src, 0);
+
+    // Idle regions stay idle, dst grows into them.
+    while (src->pool) {
+        Region* reg = src->pool;
+        src->pool = reg->next;
+        reg->next = dst->pool;
+        dst->pool = reg;
+        ARENA_SET_OWNER(reg, dst);
+    }
+#ifdef ARENA_PAGE_MAP
+    for (Region* reg = src->start; reg; reg = reg->next) {
+        reg->arena = dst;
+    }
+#endif
+
+    // src's header lives on in front of the region create_arena gave it.
+    if (src->header_flags == ARENA_HEADER_WITH_REGION) {
+        ((Region*)((char*)src + ARENA_HEADER_BYTES))->flags = REGION_HEADER_BLOCK;
+    }
+    src->last->next = dst->start;
+    dst->start = src->start;
+
+    if (src->header_flags == ARENA_HEADER_MALLOC) {
+        free(src);
+    }
+    return 0;
+}
+
+void arena_set_growth(Arena* arena, ArenaGrowth growth)
+{
+    arena->growth = growth;
+}
+
+void arena_set_backfill(Arena* arena, int enabled)
+{
+    arena->backfill = enabled ? 1 : 0;
+    memset(arena->tails, 0, sizeof(arena->tails));
+}
+
+// Plain word copy that may cross redzones. The volatile read keeps it from
+// turning into a memcpy call, which ASan would check anyway.
+ARENA_NO_SANITIZE
+static void arena_copy_words(uintptr_t* out, const uintptr_t* words, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        out[i] = ((const volatile uintptr_t*)words)[i];
+    }
+}
+
+int arena_write_image(Arena* arena, const void* root, const char* path)
+{
+    Region* reg = arena->start;
+    if (reg->next) {
+        printf("Only single region arenas can be written as an image\n");
+        return -1;
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        printf("Failed to open arena image: %s\n", path);
+        return -1;
+    }
+
+    char page[ARENA_IMAGE_DATA_OFFSET];
+    memset(page, 0, sizeof(page));
+    ArenaImageHeader* header = (ArenaImageHeader*)page;
+    memcpy(header->magic, ARENA_IMAGE_MAGIC, sizeof(ARENA_IMAGE_MAGIC));
+    header->version = ARENA_IMAGE_VERSION;
+    header->word_size = sizeof(uintptr_t);
+    header->root_offset = root ? (uint64_t)((const char*)root - (const char*)reg->data) : 0;
+    header->used_bytes = reg->data_count * sizeof(uintptr_t);
+    header->capacity = reg->capacity;
+
+    // The region is stored full, with no spare capacity and no successor.
+    Region image;
+    memset(&image, 0, sizeof(image));
+    image.data_count = reg->data_count;
+    image.capacity = reg->data_count;
+
+    // Copied out in chunks so redzones are read without unpoisoning live data.
+    uintptr_t chunk[512];
+    int ok = fwrite(page, sizeof(page), 1, file) == 1 && fwrite(&image, sizeof(image), 1, file) == 1;
+    for (uint32_t i = 0; ok && i < reg->data_count; i += 512) {
+        uint32_t n = reg->data_count - i < 512 ? reg->data_count - i : 512;
+        arena_copy_words(chunk, &reg->data[i], n);
+        ok = fwrite(chunk, sizeof(uintptr_t), n, file) == n;
+    }
+
+    if (fclose(file) != 0 || !ok) {
+        printf("Failed to write arena image: %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+Arena* arena_map_image(const char* path, void** root)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("Failed to open arena image: %s\n", path);
+        return NULL;
+    }
+
+    ArenaImageHeader header;
+    struct stat st;
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header)
+        || memcmp(header.magic, ARENA_IMAGE_MAGIC, sizeof(ARENA_IMAGE_MAGIC)) != 0
+        || header.version != ARENA_IMAGE_VERSION
+        || header.word_size != sizeof(uintptr_t)
+        || header.used_bytes % sizeof(uintptr_t) != 0
+        || header.used_bytes > (uint64_t)UINT32_MAX * sizeof(uintptr_t)
+        || header.capacity > UINT32_MAX
+        || (header.root_offset != 0 && header.root_offset >= header.used_bytes)
+        || fstat(fd, &st) != 0
+        || (uint64_t)st.st_size < ARENA_IMAGE_DATA_OFFSET + sizeof(Region) + header.used_bytes) {
+        printf("Not a valid arena image: %s\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    size_t length = sizeof(Region) + header.used_bytes;
+    void* map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, ARENA_IMAGE_DATA_OFFSET);
+    close(fd);
+    if (map == MAP_FAILED) {
+        printf("Failed to map arena image: %s\n", path);
+        return NULL;
+    }
+
+    Arena* arena = (Arena*)malloc(sizeof(Arena));
+    if (!arena) {
+        munmap(map, length);
+        return NULL;
+    }
+    // The region header must describe exactly the data the file holds.
+    Region* reg = (Region*)map;
+    if ((uint64_t)reg->data_count * sizeof(uintptr_t) != header.used_bytes || reg->capacity != reg->data_count) {
+        printf("Corrupt arena image: %s\n", path);
+        munmap(map, length);
+        free(arena);
+        return NULL;
+    }
+    reg->next = NULL;
+    reg->flags = REGION_MAPPED;
+    reg->fd = -1;
+    ARENA_SET_OWNER(reg, arena);
+    ARENA_PAGE_MAP_ADD(reg);
+    arena_init_header(arena);
+    arena->region_size = (uint32_t)header.capacity;
+    arena->start = reg;
+    arena->end = reg;
+    arena->last = reg;
+
+    if (root) {
+        *root = (char*)reg->data + header.root_offset;
+    }
+    return arena;
+}
+
+typedef struct ArenaSnapshotSpan {
+    uintptr_t start;
+    uintptr_t end;
+    uint64_t file_offset; // Of the span's first data byte
+} ArenaSnapshotSpan;
+
+static int arena_snapshot_span_cmp(const void* a, const void* b)
+{
+    uintptr_t x = ((const ArenaSnapshotSpan*)a)->start;
+    uintptr_t y = ((const ArenaSnapshotSpan*)b)->start;
+    return (x > y) - (x < y);
+}
+
+// Copies n words into out, replacing pointers into the arena with file
+// offsets and appending the file offset of each such word to relocs.
+ARENA_NO_SANITIZE
+static int arena_snapshot_translate(const uintptr_t* words, size_t n, uintptr_t* out, uint64_t out_offset,
+    const ArenaSnapshotSpan* spans, size_t num_spans, uint64_t** relocs, uint64_t* reloc_count, uint64_t* reloc_capacity)
+{
+    uintptr_t lo = spans[0].start;
+    uintptr_t hi = spans[num_spans - 1].end;
+
+    for (size_t i = 0; i < n; i++) {
+        uintptr_t w = words[i];
+        out[i] = w;
+        // One past the end of a region is a valid pointer too.
+        if (w < lo || w > hi) {
+            continue;
+        }
+
+        size_t a = 0;
+        size_t b = num_spans;
+        while (b - a > 1) {
+            size_t mid = (a + b) / 2;
+            if (spans[mid].start <= w) {
+                a = mid;
+            } else {
+                b = mid;
+            }
+        }
+        if (w > spans[a].end) {
+            continue;
+        }
+
+        if (*reloc_count == *reloc_capacity) {
+            uint64_t capacity = *reloc_capacity ? *reloc_capacity * 2 : 4096;
+            uint64_t* grown = (uint64_t*)realloc(*relocs, capacity * sizeof(uint64_t));
+            if (!grown) {
+                return 0;
+            }
+            *relocs = grown;
+            *reloc_capacity = capacity;
+        }
+        (*relocs)[(*reloc_count)++] = out_offset + i * sizeof(uintptr_t);
+        out[i] = (uintptr_t)(spans[a].file_offset + (w - spans[a].start));
+    }
+    return 1;
+}
+
+int arena_snapshot(Arena* arena, const void* root, const char* path)
+{
+    uint64_t region_count = 0;
+    for (Region* curr = arena->start; curr; curr = curr->next) {
+        region_count += curr->data_count > 0 || (curr == arena->start && !region_count);
+    }
+
+    ArenaSnapshotSpan* spans = (ArenaSnapshotSpan*)malloc(region_count * sizeof(ArenaSnapshotSpan));
+    ArenaSnapshotRegion* table = (ArenaSnapshotRegion*)calloc(region_count, sizeof(ArenaSnapshotRegion));
+    size_t prefix = ARENA_PAGE_ALIGN(sizeof(ArenaSnapshotHeader) + region_count * sizeof(ArenaSnapshotRegion));
+    const size_t chunk_words = 1 MB / sizeof(uintptr_t);
+    uintptr_t* buffer = (uintptr_t*)malloc(chunk_words * sizeof(uintptr_t));
+    uint64_t* relocs = NULL;
+    uint64_t reloc_count = 0;
+    uint64_t reloc_capacity = 0;
+    int ok = spans && table && buffer;
+
+    ArenaSnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+
+    uint64_t offset = prefix;
+    size_t n = 0;
+    for (Region* curr = arena->start; ok && curr; curr = curr->next) {
+        if (!(curr->data_count > 0 || (curr == arena->start && n == 0))) {
+            continue;
+        }
+        table[n].file_offset = offset;
+        table[n].data_count = curr->data_count;
+        table[n].capacity = curr->capacity;
+        spans[n].start = (uintptr_t)curr->data;
+        spans[n].end = (uintptr_t)&curr->data[curr->data_count];
+        spans[n].file_offset = offset + sizeof(Region);
+        if (root && (uintptr_t)root >= spans[n].start && (uintptr_t)root < spans[n].end) {
+            header.root_offset = spans[n].file_offset + ((uintptr_t)root - spans[n].start);
+        }
+        offset = ARENA_PAGE_ALIGN(offset + sizeof(Region) + curr->data_count * sizeof(uintptr_t));
+        n += 1;
+    }
+    size_t num_spans = n;
+    if (ok) {
+        qsort(spans, num_spans, sizeof(ArenaSnapshotSpan), arena_snapshot_span_cmp);
+    }
+
+    FILE* file = ok ? fopen(path, "wb") : NULL;
+    if (!file) {
+        printf("Failed to open arena snapshot: %s\n", path);
+        free(spans);
+        free(table);
+        free(buffer);
+        return -1;
+    }
+
+    static const char zeros[4096] = { 0 };
+    ok = fseek(file, (long)prefix, SEEK_SET) == 0;
+    n = 0;
+    for (Region* curr = arena->start; ok && curr; curr = curr->next) {
+        if (!(curr->data_count > 0 || (curr == arena->start && n == 0))) {
+            continue;
+        }
+        Region image;
+        memset(&image, 0, sizeof(image));
+        image.data_count = curr->data_count;
+        image.capacity = curr->data_count;
+        ok = fwrite(&image, sizeof(image), 1, file) == 1;
+
+        uint64_t data_offset = table[n].file_offset + sizeof(Region);
+        for (size_t i = 0; ok && i < curr->data_count; i += chunk_words) {
+            size_t words = curr->data_count - i < chunk_words ? curr->data_count - i : chunk_words;
+            ok = arena_snapshot_translate(&curr->data[i], words, buffer, data_offset + i * sizeof(uintptr_t),
+                     spans, num_spans, &relocs, &reloc_count, &reloc_capacity)
+                && fwrite(buffer, sizeof(uintptr_t), words, file) == words;
+        }
+
+        uint64_t written = sizeof(Region) + curr->data_count * sizeof(uintptr_t);
+        uint64_t pad = ARENA_PAGE_ALIGN(written) - written;
+        ok = ok && fwrite(zeros, 1, pad, file) == pad;
+        n += 1;
+    }
+
+    memcpy(header.magic, ARENA_SNAPSHOT_MAGIC, sizeof(ARENA_SNAPSHOT_MAGIC));
+    header.version = ARENA_SNAPSHOT_VERSION;
+    header.word_size = sizeof(uintptr_t);
+    header.region_count = n;
+    header.reloc_offset = offset;
+    header.reloc_count = reloc_count;
+
+    ok = ok && fwrite(relocs, sizeof(uint64_t), reloc_count, file) == reloc_count
+        && fseek(file, 0, SEEK_SET) == 0
+        && fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(table, sizeof(ArenaSnapshotRegion), n, file) == n;
+
+    if (fclose(file) != 0) {
+        ok = 0;
+    }
+    free(spans);
+    free(table);
+    free(buffer);
+    free(relocs);
+
+    if (!ok) {
+        printf("Failed to write arena snapshot: %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+// 1 if bytes at file offset lie in the data of one region of the table,
+// which is sorted by file offset. bytes == 0 also accepts one past the end.
+static int arena_snapshot_in_data(const ArenaSnapshotRegion* table, uint64_t count, uint64_t offset, uint64_t bytes)
+{
+    uint64_t a = 0;
+    uint64_t b = count;
+    while (b - a > 1) {
+        uint64_t mid = (a + b) / 2;
+        if (table[mid].file_offset <= offset) {
+            a = mid;
+        } else {
+            b = mid;
+        }
+    }
+    uint64_t start = table[a].file_offset + sizeof(Region);
+    uint64_t end = start + table[a].data_count * sizeof(uintptr_t);
+    return offset >= start && offset <= end && bytes <= end - offset;
+}
+
+// Checks the region table and every relocation against the file before
+// anything is written through them.
+static int arena_snapshot_validate(const char* base, const ArenaSnapshotHeader* header)
+{
+    uint64_t prefix = ARENA_PAGE_ALIGN(sizeof(ArenaSnapshotHeader) + header->region_count * sizeof(ArenaSnapshotRegion));
+    if (prefix > header->reloc_offset) {
+        return 0;
+    }
+    const ArenaSnapshotRegion* table = (const ArenaSnapshotRegion*)(base + sizeof(ArenaSnapshotHeader));
+    uint64_t next = prefix;
+    for (uint64_t i = 0; i < header->region_count; i++) {
+        if (table[i].file_offset < next || table[i].file_offset % 4096 != 0 || table[i].data_count > UINT32_MAX
+            || table[i].capacity > UINT32_MAX || table[i].file_offset > header->reloc_offset
+            || sizeof(Region) + table[i].data_count * sizeof(uintptr_t) > header->reloc_offset - table[i].file_offset) {
+            return 0;
+        }
+        next = table[i].file_offset + sizeof(Region) + table[i].data_count * sizeof(uintptr_t);
+    }
+
+    const uint64_t* relocs = (const uint64_t*)(base + header->reloc_offset);
+    for (uint64_t i = 0; i < header->reloc_count; i++) {
+        if (relocs[i] % sizeof(uintptr_t) != 0
+            || !arena_snapshot_in_data(table, header->region_count, relocs[i], sizeof(uintptr_t))
+            || !arena_snapshot_in_data(table, header->region_count, *(const uintptr_t*)(base + relocs[i]), 0)) {
+            return 0;
+        }
+    }
+    return header->root_offset == 0 || arena_snapshot_in_data(table, header->region_count, header->root_offset, 0);
+}
+
+Arena* arena_restore(const char* path, void** root)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("Failed to open arena snapshot: %s\n", path);
+        return NULL;
+    }
+
+    struct stat st;
+    ArenaSnapshotHeader header;
+    if (fstat(fd, &st) != 0
+        || pread(fd, &header, sizeof(header), 0) != sizeof(header)
+        || memcmp(header.magic, ARENA_SNAPSHOT_MAGIC, sizeof(ARENA_SNAPSHOT_MAGIC)) != 0
+        || header.version != ARENA_SNAPSHOT_VERSION
+        || header.word_size != sizeof(uintptr_t)
+        || header.region_count == 0
+        || header.region_count > (uint64_t)st.st_size / sizeof(ArenaSnapshotRegion)
+        || header.reloc_offset % sizeof(uint64_t) != 0
+        || header.reloc_offset > (uint64_t)st.st_size
+        || header.reloc_count > ((uint64_t)st.st_size - header.reloc_offset) / sizeof(uint64_t)) {
+        printf("Not a valid arena snapshot: %s\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    size_t length = (size_t)st.st_size;
+    char* base = (char*)mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        printf("Failed to map arena snapshot: %s\n", path);
+        return NULL;
+    }
+
+    if (!arena_snapshot_validate(base, &header)) {
+        printf("Corrupt arena snapshot: %s\n", path);
+        munmap(base, length);
+        return NULL;
+    }
+
+    Arena* arena = (Arena*)malloc(sizeof(Arena));
+    if (!arena) {
+        munmap(base, length);
+        return NULL;
+    }
+
+    // Pointers were stored as file offsets, rebasing is one add per pointer.
+    const uint64_t* relocs = (const uint64_t*)(base + header.reloc_offset);
+    for (uint64_t i = 0; i < header.reloc_count; i++) {
+        *(uintptr_t*)(base + relocs[i]) += (uintptr_t)base;
+    }
+
+    const ArenaSnapshotRegion* table = (const ArenaSnapshotRegion*)(base + sizeof(ArenaSnapshotHeader));
+    arena_init_header(arena);
+    Region* prev = NULL;
+    for (uint64_t i = 0; i < header.region_count; i++) {
+        Region* reg = (Region*)(base + table[i].file_offset);
+        reg->data_count = (uint32_t)table[i].data_count;
+        reg->capacity = (uint32_t)table[i].data_count;
+        if (table[i].capacity > arena->region_size) {
+            arena->region_size = (uint32_t)table[i].capacity;
+        }
+        reg->next = NULL;
+        reg->flags = REGION_MAPPED;
+        reg->fd = -1;
+        ARENA_SET_OWNER(reg, arena);
+        ARENA_PAGE_MAP_ADD(reg);
+        if (prev) {
+            prev->next = reg;
+        } else {
+            arena->start = reg;
+        }
+        prev = reg;
+    }
+    arena->end = prev;
+    arena->last = prev;
+
+    if (root) {
+        *root = header.root_offset ? base + header.root_offset : NULL;
+    }
+
+    // Each region is released on its own by region_free, drop everything else.
+    uint64_t prefix = table[0].file_offset;
+    munmap(base + header.reloc_offset, length - header.reloc_offset);
+    munmap(base, prefix);
+    return arena;
+}
+
+static Arena* arena_from_shared(ArenaSharedHeader* header)
+{
+    Arena* arena = (Arena*)malloc(sizeof(Arena));
+    if (!arena) {
+        munmap(header, header->length);
+        return NULL;
+    }
+    arena_init_header(arena);
+    arena->start = (Region*)(header + 1);
+    arena->end = arena->start;
+    arena->last = arena->start;
+    arena->growth = ARENA_GROWTH_NONE;
+    return arena;
+}
+
+Arena* create_shared_arena(const char* name, uint32_t size_bytes)
+{
+    int fd = name ? shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600) : arena_memfd("stam-arena");
+    if (fd < 0) {
+        printf("Failed to create shared arena segment: %s\n", name ? name : "(anonymous)");
+        return NULL;
+    }
+
+    size_t size = ALIGN_SIZE(size_bytes);
+    size_t length = sizeof(ArenaSharedHeader) + sizeof(Region) + size * sizeof(uintptr_t);
+    void* map = MAP_FAILED;
+    if (ftruncate(fd, (off_t)length) == 0) {
+        map = mmap((void*)(uintptr_t)ARENA_SHARED_BASE, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        printf("Failed to map shared arena segment: (%zu bytes)\n", length);
+        if (name) {
+            shm_unlink(name);
+        }
+        return NULL;
+    }
+
+    ArenaSharedHeader* header = (ArenaSharedHeader*)map;
+    memcpy(header->magic, ARENA_SHARED_MAGIC, sizeof(ARENA_SHARED_MAGIC));
+    header->base = (uint64_t)(uintptr_t)map;
+    header->length = length;
+    header->root = 0;
+
+    Region* reg = (Region*)(header + 1);
+    reg->data_count = 0;
+    reg->capacity = (uint32_t)size;
+    reg->next = NULL;
+    reg->flags = REGION_SHARED;
+    reg->fd = -1;
+    reg->zero_mark = 0;
+
+    return arena_from_shared(header);
+}
+
+Arena* arena_attach_shared(const char* name)
+{
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        printf("Failed to open shared arena segment: %s\n", name);
+        return NULL;
+    }
+
+    ArenaSharedHeader header;
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header)
+        || memcmp(header.magic, ARENA_SHARED_MAGIC, sizeof(ARENA_SHARED_MAGIC)) != 0) {
+        printf("Not a shared arena segment: %s\n", name);
+        close(fd);
+        return NULL;
+    }
+
+    void* map = mmap((void*)(uintptr_t)header.base, header.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        printf("Failed to map shared arena segment: %s\n", name);
+        return NULL;
+    }
+    if ((uint64_t)(uintptr_t)map != header.base) {
+        printf("Shared arena segment %s could not be mapped at %#" PRIx64 "\n", name, header.base);
+        munmap(map, header.length);
+        return NULL;
+    }
+
+    return arena_from_shared((ArenaSharedHeader*)map);
+}
+
+void* arena_allocate_shared(Arena* arena, uint32_t size_bytes)
+{
+    ARENA_TRACE_EVENT(ARENA_TRACE_ALLOC, arena, size_bytes);
+
+    Region* reg = arena->start;
+    uint32_t size = (uint32_t)(ALIGN_SIZE(size_bytes) + ARENA_REDZONE_WORDS);
+    uint32_t count = __atomic_load_n(&reg->data_count, __ATOMIC_RELAXED);
+
+    do {
+        if (reg->capacity - count < size) {
+            printf("Shared arena is out of space: (%" PRIu32 " bytes)\n", size_bytes);
+            return NULL;
+        }
+    } while (!__atomic_compare_exchange_n(&reg->data_count, &count, count + size, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    void* res = &reg->data[count + ARENA_REDZONE_WORDS];
+    ARENA_UNPOISON(res, size_bytes);
+    return res;
+}
+
+void arena_shared_publish(Arena* arena, void* root)
+{
+    ArenaSharedHeader* header = (ArenaSharedHeader*)arena->start - 1;
+    __atomic_store_n(&header->root, (uint64_t)(uintptr_t)root, __ATOMIC_RELEASE);
+}
+
+void* arena_shared_root(Arena* arena)
+{
+    ArenaSharedHeader* header = (ArenaSharedHeader*)arena->start - 1;
+    return (void*)(uintptr_t)__atomic_load_n(&header->root, __ATOMIC_ACQUIRE);
+}
+
+FrameArena* create_frame_arena(uint32_t frames, uint32_t size_bytes)
+{
+    if (frames == 0 || frames > FRAME_ARENA_MAX) {
+        printf("Frame arenas need between 1 and %d frames, got %" PRIu32 "\n", FRAME_ARENA_MAX, frames);
+        return NULL;
+    }
+
+    FrameArena* frame = (FrameArena*)malloc(sizeof(FrameArena));
+    if (!frame) {
+        return NULL;
+    }
+    frame->frames = frames;
+    frame->current = 0;
+    frame->tick = 0;
+    for (uint32_t i = 0; i < frames; i++) {
+        frame->arenas[i] = create_arena(size_bytes);
+        if (!frame->arenas[i]) {
+            frame->frames = i;
+            frame_arena_free(frame);
+            return NULL;
+        }
+    }
+    return frame;
+}
+
+void* frame_arena_allocate(FrameArena* frame, uint32_t size_bytes)
+{
+    return arena_allocate(frame->arenas[frame->current], size_bytes);
+}
+
+Arena* frame_arena_current(FrameArena* frame)
+{
+    return frame->arenas[frame->current];
+}
 
-#define ALIGN_SIZE(size_bytes) (size_bytes + sizeof(uintptr_t) - 1) / sizeof(uintptr_t);
+void frame_arena_advance(FrameArena* frame)
+{
+    frame->current = frame->current + 1 == frame->frames ? 0 : frame->current + 1;
+    frame->tick += 1;
+    arena_reset(frame->arenas[frame->current]);
+}
 
-typedef struct Region {
-    uint32_t data_count;
-    uint32_t capacity;
-    struct Region* next;
-    uintptr_t data[];
-} Region;
+void frame_arena_free(FrameArena* frame)
+{
+    for (uint32_t i = 0; i < frame->frames; i++) {
+        arena_free(frame->arenas[i]);
+    }
+    free(frame);
+}
 
-typedef struct Arena {
-    Region* start;
-    Region* end;
-} Arena;
+EpochArena* create_epoch_arena(uint32_t size_bytes)
+{
+    EpochArena* epochs = (EpochArena*)malloc(sizeof(EpochArena));
+    if (!epochs) {
+        return NULL;
+    }
+    memset(epochs, 0, sizeof(EpochArena));
+    for (int i = 0; i < EPOCH_ARENA_READERS; i++) {
+        epochs->readers[i].epoch = EPOCH_ARENA_IDLE;
+    }
+    for (int i = 0; i < EPOCH_ARENA_EPOCHS; i++) {
+        epochs->arenas[i] = create_arena(size_bytes);
+        if (!epochs->arenas[i]) {
+            epoch_arena_free(epochs);
+            return NULL;
+        }
+    }
+    return epochs;
+}
 
-typedef struct ArenaMark {
-    Region* reg;
-    uint32_t count;
-} ArenaMark;
+int epoch_arena_register(EpochArena* epochs)
+{
+    for (int i = 0; i < EPOCH_ARENA_READERS; i++) {
+        uint32_t expected = 0;
+        if (__atomic_compare_exchange_n(&epochs->readers[i].used, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return i;
+        }
+    }
+    printf("All %d epoch arena reader slots are taken\n", EPOCH_ARENA_READERS);
+    return -1;
+}
 
-Region* create_region(uint32_t size_bytes);
-void* region_allocate(Region* reg, uint32_t size_bytes);
-void region_reset(Region* reg);
-void region_free(Region* reg);
-void print_region(Region* reg);
+void epoch_arena_unregister(EpochArena* epochs, int reader)
+{
+    __atomic_store_n(&epochs->readers[reader].epoch, EPOCH_ARENA_IDLE, __ATOMIC_RELEASE);
+    __atomic_store_n(&epochs->readers[reader].used, 0, __ATOMIC_RELEASE);
+}
 
-Arena* create_arena(uint32_t size_bytes);
-void* arena_allocate(Arena* arena, uint32_t size_bytes);
-void arena_reset(Arena* arena);
-void arena_free(Arena* arena);
-void print_arena(Arena* arena);
+uint64_t epoch_arena_pin(EpochArena* epochs, int reader)
+{
+    uint64_t epoch = __atomic_load_n(&epochs->epoch, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&epochs->readers[reader].epoch, epoch, __ATOMIC_RELAXED);
+    // The pin has to be visible to advancing before the reader loads any roots.
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return epoch;
+}
 
-ArenaMark arena_scratch(Arena* arena);
-void arena_pop_scratch(Arena* arena, ArenaMark m);
+void epoch_arena_unpin(EpochArena* epochs, int reader)
+{
+    __atomic_store_n(&epochs->readers[reader].epoch, EPOCH_ARENA_IDLE, __ATOMIC_RELEASE);
+}
 
-#ifdef ARENA_CPP
+void* epoch_arena_allocate(EpochArena* epochs, uint32_t size_bytes)
+{
+    return arena_allocate(epoch_arena_current(epochs), size_bytes);
+}
 
-struct ArenaCPP {
+Arena* epoch_arena_current(EpochArena* epochs)
+{
+    return epochs->arenas[epochs->epoch % EPOCH_ARENA_EPOCHS];
+}
 
-    ArenaCPP(uint32_t size_bytes)
-    {
-        arena = create_arena(size_bytes);
+int epoch_arena_advance(EpochArena* epochs)
+{
+    uint64_t epoch = epochs->epoch;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (int i = 0; i < EPOCH_ARENA_READERS; i++) {
+        uint64_t pinned = __atomic_load_n(&epochs->readers[i].epoch, __ATOMIC_ACQUIRE);
+        if (pinned != EPOCH_ARENA_IDLE && pinned != epoch) {
+            return 0;
+        }
     }
-    ~ArenaCPP()
-    {
-        arena_free(arena);
+    // Readers are all in epoch or later, none can reach what epoch - 2 allocated.
+    arena_reset(epochs->arenas[(epoch + 1) % EPOCH_ARENA_EPOCHS]);
+    __atomic_store_n(&epochs->epoch, epoch + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+void epoch_arena_free(EpochArena* epochs)
+{
+    for (int i = 0; i < EPOCH_ARENA_EPOCHS; i++) {
+        if (epochs->arenas[i]) {
+            arena_free(epochs->arenas[i]);
+        }
     }
+    free(epochs);
+}
 
-    template <typename T, typename... Args>
-    T* construct(Args... args)
-    {
-        void* obj = arena_allocate(arena, sizeof(T));
-        return new (obj) T(args...);
-    };
+void* arena_allocate_aligned(Arena* arena, uint32_t size_bytes, uint32_t alignment)
+{
+    // Traced as asked for, the padding is the replay's business.
+    ARENA_TRACE_ALIGNED_EVENT(ARENA_TRACE_ALLOC, arena, size_bytes, alignment > sizeof(uintptr_t) ? alignment : sizeof(uintptr_t));
 
-    template <typename T>
-    T* allocate()
-    {
-        return (T*)arena_allocate(arena, sizeof(T));
-    };
+    Region* reg;
+    if (alignment <= sizeof(uintptr_t)) {
+        return arena_allocate_from(arena, size_bytes, &reg);
+    }
+    uintptr_t res = (uintptr_t)arena_allocate_from(arena, size_bytes + alignment - sizeof(uintptr_t), &reg);
+    if (!res) {
+        return NULL;
+    }
+    return (void*)((res + alignment - 1) & ~(uintptr_t)(alignment - 1));
+}
 
-    ArenaMark mark()
-    {
-        return arena_scratch(arena);
+void* arena_realloc(Arena* arena, void* ptr, uint32_t old_size_bytes, uint32_t new_size_bytes)
+{
+    if (!ptr) {
+        return arena_allocate(arena, new_size_bytes);
     }
 
-    void reset()
-    {
-        arena_reset(arena);
+    Region* reg = arena->end;
+    uintptr_t* start = (uintptr_t*)ptr;
+    size_t old_size = ALIGN_SIZE(old_size_bytes);
+    size_t new_size = ALIGN_SIZE(new_size_bytes);
+
+    if (start + old_size == &reg->data[reg->data_count]
+        && (size_t)(start - reg->data) + new_size <= reg->capacity) {
+        if (new_size > old_size) {
+            ARENA_TRACE_EVENT(ARENA_TRACE_ALLOC, arena, (uint32_t)((new_size - old_size) * sizeof(uintptr_t)));
+        }
+        ARENA_UNPOISON(ptr, new_size_bytes);
+        if (new_size_bytes < old_size_bytes) {
+            ARENA_POISON((char*)ptr + new_size_bytes, old_size * sizeof(uintptr_t) - new_size_bytes);
+        }
+        region_raise_zero_mark(reg);
+        reg->data_count = (uint32_t)((start - reg->data) + new_size);
+        return ptr;
     }
 
-    void reset(ArenaMark mark)
-    {
-        arena_pop_scratch(arena, mark);
+    if (new_size_bytes <= old_size_bytes) {
+        return ptr;
+    }
+    void* res = arena_allocate(arena, new_size_bytes);
+    if (res) {
+        memcpy(res, ptr, old_size_bytes);
     }
+    return res;
+}
 
-    void print()
-    {
-        print_arena(arena);
+ArenaString arena_string_begin(Arena* arena, uint32_t capacity_hint)
+{
+    ArenaString str;
+    str.arena = arena;
+    str.length = 0;
+    str.capacity = capacity_hint < 16 ? 16 : capacity_hint;
+    str.data = (char*)arena_allocate(arena, str.capacity);
+    if (!str.data) {
+        str.capacity = 0;
     }
+    return str;
+}
 
-private:
-    Arena* arena;
-};
+// Make room for extra bytes plus the null terminator.
+static int arena_string_reserve(ArenaString* str, uint32_t extra)
+{
+    uint32_t needed = str->length + extra + 1;
+    if (needed <= str->capacity) {
+        return 1;
+    }
+    uint32_t new_capacity = str->capacity * 2;
+    if (new_capacity < needed) {
+        new_capacity = needed;
+    }
+    char* data = (char*)arena_realloc(str->arena, str->data, str->capacity, new_capacity);
+    if (!data) {
+        printf("Failed to grow arena string to %" PRIu32 " bytes\n", new_capacity);
+        return 0;
+    }
+    str->data = data;
+    str->capacity = new_capacity;
+    return 1;
+}
 
-#endif // ARENA_CPP
+void arena_string_append(ArenaString* str, const char* data, uint32_t length)
+{
+    if (!arena_string_reserve(str, length)) {
+        return;
+    }
+    memcpy(str->data + str->length, data, length);
+    str->length += length;
+}
 
-#ifdef ARENA_IMPLEMENTATION
+void arena_string_append_cstr(ArenaString* str, const char* cstr)
+{
+    arena_string_append(str, cstr, (uint32_t)strlen(cstr));
+}
 
-Region* create_region(uint32_t size_bytes)
+void arena_string_appendf(ArenaString* str, const char* fmt, ...)
 {
-    size_t size = ALIGN_SIZE(size_bytes);
+    va_list args;
+    va_start(args, fmt);
+    uint32_t available = str->capacity > str->length ? str->capacity - str->length : 0;
+    int written = vsnprintf(str->data + str->length, available, fmt, args);
+    va_end(args);
 
-    Region* region = (Region*)malloc(sizeof(Region) + size * sizeof(uintptr_t));
+    if (written < 0) {
+        return;
+    }
+    if ((uint32_t)written >= available) {
+        if (!arena_string_reserve(str, (uint32_t)written)) {
+            return;
+        }
+        va_start(args, fmt);
+        vsnprintf(str->data + str->length, (uint32_t)written + 1, fmt, args);
+        va_end(args);
+    }
+    str->length += (uint32_t)written;
+}
 
-    if (!region) {
-        printf("Failed to allocate region: (%lu bytes)\n", sizeof(Region) + size * sizeof(uintptr_t));
+const char* arena_string_end(ArenaString* str)
+{
+    if (!arena_string_reserve(str, 0)) {
         return NULL;
     }
-    region->data_count = 0;
-    region->capacity = size;
-    region->next = NULL;
+    str->data[str->length] = '\0';
+    str->data = (char*)arena_realloc(str->arena, str->data, str->capacity, str->length + 1);
+    str->capacity = str->length + 1;
+    return str->data;
+}
 
-    return region;
-};
+uint32_t arena_hash_bytes(const void* data, uint32_t length)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ (length * 0xFF51AFD7ED558CCDull);
 
-void* region_allocate(Region* reg, uint32_t size_bytes)
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        h = (h ^ word) * 0xC4CEB9FE1A85EC53ull;
+        h ^= h >> 29;
+        p += 8;
+        length -= 8;
+    }
+    if (length) {
+        uint64_t word = 0;
+        memcpy(&word, p, length);
+        h = (h ^ word) * 0xC4CEB9FE1A85EC53ull;
+    }
+    h ^= h >> 32;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 29;
+    return (uint32_t)h;
+}
+
+int arena_bytes_equal(const void* a, const void* b, uint32_t length)
 {
+    const unsigned char* pa = (const unsigned char*)a;
+    const unsigned char* pb = (const unsigned char*)b;
+#if defined(__AVX2__)
+    while (length >= 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)pa);
+        __m256i y = _mm256_loadu_si256((const __m256i*)pb);
+        if ((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) != 0xFFFFFFFFu) {
+            return 0;
+        }
+        pa += 32;
+        pb += 32;
+        length -= 32;
+    }
+#endif
+#if defined(__SSE2__)
+    while (length >= 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)pa);
+        __m128i y = _mm_loadu_si128((const __m128i*)pb);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xFFFF) {
+            return 0;
+        }
+        pa += 16;
+        pb += 16;
+        length -= 16;
+    }
+#endif
+    return memcmp(pa, pb, length) == 0;
+}
 
-    size_t size = ALIGN_SIZE(size_bytes);
+void arena_intern_init(ArenaIntern* table, Arena* arena, uint32_t capacity)
+{
+    uint32_t cap = 16;
+    while (cap < capacity) {
+        cap *= 2;
+    }
+    table->arena = arena;
+    table->count = 0;
+    table->capacity = cap;
+    table->entries = (ArenaInternEntry*)arena_allocate(arena, cap * sizeof(ArenaInternEntry));
+    if (!table->entries) {
+        table->capacity = 0;
+        return;
+    }
+    memset(table->entries, 0, cap * sizeof(ArenaInternEntry));
+}
 
-    if (reg->data_count + size > reg->capacity) {
-        printf("Tried to region_allocate size (%" PRIu64 ") greater than capacity (%" PRIu32 ")\n", reg->data_count + size, reg->capacity);
+static int arena_intern_grow(ArenaIntern* table)
+{
+    uint32_t capacity = table->capacity ? table->capacity * 2 : 16;
+    ArenaInternEntry* entries = (ArenaInternEntry*)arena_allocate(table->arena, capacity * sizeof(ArenaInternEntry));
+    if (!entries) {
+        printf("Failed to grow intern table to %" PRIu32 " entries\n", capacity);
+        return 0;
+    }
+    memset(entries, 0, capacity * sizeof(ArenaInternEntry));
+
+    for (uint32_t i = 0; i < table->capacity; i++) {
+        ArenaInternEntry* e = &table->entries[i];
+        if (!e->str) {
+            continue;
+        }
+        uint32_t j = e->hash & (capacity - 1);
+        while (entries[j].str) {
+            j = (j + 1) & (capacity - 1);
+        }
+        entries[j] = *e;
+    }
+
+    table->entries = entries;
+    table->capacity = capacity;
+    return 1;
+}
+
+const char* arena_intern(ArenaIntern* table, const char* str, uint32_t length)
+{
+    if ((table->count + 1) * 4 > table->capacity * 3 && !arena_intern_grow(table)) {
         return NULL;
     }
 
-    void* res = &reg->data[reg->data_count];
-    reg->data_count += size;
+    uint32_t hash = arena_hash_bytes(str, length);
+    uint32_t mask = table->capacity - 1;
+    uint32_t i = hash & mask;
 
-    return res;
+    while (table->entries[i].str) {
+        ArenaInternEntry* e = &table->entries[i];
+        if (e->hash == hash && e->length == length && arena_bytes_equal(e->str, str, length)) {
+            return e->str;
+        }
+        i = (i + 1) & mask;
+    }
+
+    char* copy = (char*)arena_allocate(table->arena, length + 1);
+    if (!copy) {
+        return NULL;
+    }
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+
+    table->entries[i].str = copy;
+    table->entries[i].length = length;
+    table->entries[i].hash = hash;
+    table->count += 1;
+    return copy;
 }
 
-inline void region_reset(Region* reg)
+const char* arena_intern_cstr(ArenaIntern* table, const char* cstr)
 {
-    reg->data_count = 0;
+    return arena_intern(table, cstr, (uint32_t)strlen(cstr));
 }
-inline void region_free(Region* reg)
+
+static int arena_compact_span_cmp(const void* a, const void* b)
 {
-    free(reg);
+    uintptr_t x = *(const uintptr_t*)a;
+    uintptr_t y = *(const uintptr_t*)b;
+    return (x > y) - (x < y);
 }
 
-void print_region(Region* reg)
+// End of the used src span holding p, 0 if p is not in src.
+static uintptr_t arena_compact_span_end(ArenaCompact* compact, uintptr_t p)
 {
-    if (!reg) {
-        printf("Region is null, could not print.");
-        return;
+    size_t a = 0;
+    size_t b = compact->num_spans;
+    if (b == 0 || p < compact->spans[0]) {
+        return 0;
     }
-    printf("Used: %" PRIu64 " bytes\n", reg->data_count * sizeof(uintptr_t));
-    printf("Capacity: %" PRIu64 " bytes\n", reg->capacity * sizeof(uintptr_t));
+    while (b - a > 1) {
+        size_t mid = (a + b) / 2;
+        if (compact->spans[2 * mid] <= p) {
+            a = mid;
+        } else {
+            b = mid;
+        }
+    }
+    return p < compact->spans[2 * a + 1] ? compact->spans[2 * a + 1] : 0;
 }
 
-Arena* create_arena(uint32_t size_bytes)
+static inline size_t arena_compact_hash(uintptr_t p, size_t capacity)
 {
-    Arena* arena = (Arena*)malloc(sizeof(Arena));
-
-    arena->start = create_region(size_bytes);
-    arena->end = arena->start;
-
-    return arena;
-};
+    return (size_t)(((p >> 3) * 0x9E3779B97F4A7C15ull) >> 32) & (capacity - 1);
+}
 
-void* arena_allocate(Arena* arena, uint32_t size_bytes)
+// The new address of old, or 0 if it has not been copied yet.
+static uintptr_t arena_compact_lookup(ArenaCompact* compact, uintptr_t old)
 {
-    Region* curr = arena->end;
-
-    size_t size = ALIGN_SIZE(size_bytes);
+    size_t i = arena_compact_hash(old, compact->forward_capacity);
+    while (compact->forward[2 * i]) {
+        if (compact->forward[2 * i] == old) {
+            return compact->forward[2 * i + 1];
+        }
+        i = (i + 1) & (compact->forward_capacity - 1);
+    }
+    return 0;
+}
 
-    while (curr->capacity - curr->data_count < size) {
-        if (curr->next == NULL) {
-            uint32_t new_size = curr->capacity;
-            if (size > curr->capacity) {
-                new_size = size;
-            }
-            curr->next = create_region(new_size * sizeof(uintptr_t));
-            if (!curr->next) {
-                printf("Failed to allocate new region for arena\n");
-                return NULL;
+static int arena_compact_insert(ArenaCompact* compact, uintptr_t old, uintptr_t moved)
+{
+    if (2 * (compact->copied + 1) > compact->forward_capacity) {
+        size_t capacity = compact->forward_capacity * 2;
+        uintptr_t* grown = (uintptr_t*)calloc(capacity, 2 * sizeof(uintptr_t));
+        if (!grown) {
+            return 0;
+        }
+        for (size_t j = 0; j < compact->forward_capacity; j++) {
+            if (compact->forward[2 * j]) {
+                size_t i = arena_compact_hash(compact->forward[2 * j], capacity);
+                while (grown[2 * i]) {
+                    i = (i + 1) & (capacity - 1);
+                }
+                grown[2 * i] = compact->forward[2 * j];
+                grown[2 * i + 1] = compact->forward[2 * j + 1];
             }
         }
-        curr = curr->next;
+        free(compact->forward);
+        compact->forward = grown;
+        compact->forward_capacity = capacity;
     }
-    arena->end = curr;
-    return region_allocate(arena->end, size_bytes);
+    size_t i = arena_compact_hash(old, compact->forward_capacity);
+    while (compact->forward[2 * i]) {
+        i = (i + 1) & (compact->forward_capacity - 1);
+    }
+    compact->forward[2 * i] = old;
+    compact->forward[2 * i + 1] = moved;
+    compact->copied += 1;
+    return 1;
 }
 
-ArenaMark arena_scratch(Arena* arena)
+void arena_compact_visit(ArenaCompact* compact, void** slot, uint32_t size_bytes, ArenaCompactTrace trace)
 {
-    ArenaMark mark;
-    if (arena->end == NULL) {
-        printf("Tried to make a scrach arena for an uninitialized arena");
-        return mark;
+    uintptr_t end = compact->failed || !*slot ? 0 : arena_compact_span_end(compact, (uintptr_t)*slot);
+    if (!end) {
+        return;
     }
-    mark.reg = arena->end;
-    mark.count = arena->end->data_count;
-
-    return mark;
+    if ((uintptr_t)*slot + size_bytes > end) {
+        printf("Compacted object runs past the end of its region: (%" PRIu32 " bytes)\n", size_bytes);
+        compact->failed = 1;
+        return;
+    }
+    if (compact->work_count == compact->work_capacity) {
+        size_t capacity = compact->work_capacity ? compact->work_capacity * 2 : 1024;
+        ArenaCompactSlot* grown = (ArenaCompactSlot*)realloc(compact->work, capacity * sizeof(ArenaCompactSlot));
+        if (!grown) {
+            printf("Failed to grow the compaction work list: (%zu slots)\n", capacity);
+            compact->failed = 1;
+            return;
+        }
+        compact->work = grown;
+        compact->work_capacity = capacity;
+    }
+    ArenaCompactSlot item = { slot, size_bytes, trace };
+    compact->work[compact->work_count++] = item;
 }
-void arena_pop_scratch(Arena* arena, ArenaMark m)
+
+// Depth first pops from the back, so slots pushed since before are flipped
+// to come off in the order they were visited.
+static void arena_compact_order_pushed(ArenaCompact* compact, size_t before)
 {
-    if (m.reg == NULL) {
-        arena_reset(arena);
+    if (compact->order != ARENA_COMPACT_DFS) {
         return;
     }
-    m.reg->data_count = m.count;
-    Region* curr = m.reg->next;
-    while (curr) {
-        curr->data_count = 0;
+    for (size_t i = before, j = compact->work_count; i + 1 < j; i++, j--) {
+        ArenaCompactSlot tmp = compact->work[i];
+        compact->work[i] = compact->work[j - 1];
+        compact->work[j - 1] = tmp;
     }
-    arena->end = m.reg;
 }
 
-void arena_reset(Arena* arena)
+// Copies the object behind item's slot unless that was done already, and
+// points the slot at the copy.
+static void arena_compact_move(ArenaCompact* compact, ArenaCompactSlot item)
 {
-    Region* curr = arena->start;
-    while (curr) {
-        region_reset(curr);
-        curr = curr->next;
+    uintptr_t old = (uintptr_t)*item.slot;
+    uintptr_t moved = arena_compact_lookup(compact, old);
+    if (moved) {
+        *item.slot = (void*)moved;
+        return;
+    }
+
+    void* copy = arena_allocate(compact->dst, item.size);
+    if (!copy || !arena_compact_insert(compact, old, (uintptr_t)copy)) {
+        printf("Failed to copy object during compaction: (%" PRIu32 " bytes)\n", item.size);
+        compact->failed = 1;
+        return;
+    }
+    memcpy(copy, (void*)old, item.size);
+    *item.slot = copy;
+
+    if (item.trace) {
+        size_t before = compact->work_count;
+        item.trace(compact, copy);
+        arena_compact_order_pushed(compact, before);
     }
-    arena->end = arena->start;
 }
 
-void arena_free(Arena* arena)
+int64_t arena_compact(Arena* src, Arena* dst, ArenaCompactOrder order, void (*visitor)(ArenaCompact* compact), void* user)
 {
-    Region* curr = arena->start;
-    while (curr) {
-        Region* tmp = curr->next;
-        region_free(curr);
-        curr = tmp;
+    if (src == dst) {
+        printf("Cannot compact an arena into itself\n");
+        return -1;
+    }
+
+    ArenaCompact compact;
+    memset(&compact, 0, sizeof(compact));
+    compact.src = src;
+    compact.dst = dst;
+    compact.user = user;
+    compact.order = order;
+
+    size_t regions = 0;
+    for (Region* curr = src->start; curr; curr = curr->next) {
+        regions += 1;
+    }
+    compact.forward_capacity = 1024;
+    compact.spans = (uintptr_t*)malloc(regions * 2 * sizeof(uintptr_t) + 1);
+    compact.forward = (uintptr_t*)calloc(compact.forward_capacity, 2 * sizeof(uintptr_t));
+    if (!compact.spans || !compact.forward) {
+        printf("Failed to set up compaction of %zu regions\n", regions);
+        free(compact.spans);
+        free(compact.forward);
+        return -1;
+    }
+    for (Region* curr = src->start; curr; curr = curr->next) {
+        if (curr->data_count) {
+            compact.spans[2 * compact.num_spans] = (uintptr_t)curr->data;
+            compact.spans[2 * compact.num_spans + 1] = (uintptr_t)&curr->data[curr->data_count];
+            compact.num_spans += 1;
+        }
+    }
+    qsort(compact.spans, compact.num_spans, 2 * sizeof(uintptr_t), arena_compact_span_cmp);
+
+    visitor(&compact);
+    arena_compact_order_pushed(&compact, 0);
+    while (!compact.failed && compact.work_head < compact.work_count) {
+        ArenaCompactSlot item;
+        if (order == ARENA_COMPACT_DFS) {
+            item = compact.work[--compact.work_count];
+        } else {
+            item = compact.work[compact.work_head++];
+        }
+        arena_compact_move(&compact, item);
     }
 
-    free(arena);
+    free(compact.spans);
+    free(compact.forward);
+    free(compact.work);
+    if (compact.failed) {
+        return -1;
+    }
+    arena_reset(src);
+    return (int64_t)compact.copied;
 }
 
 void print_arena(Arena* arena)
@@ -255,6 +4292,15 @@ void print_arena(Arena* arena)
     printf("Total Used: %" PRIu64 " bytes\n", total_used * sizeof(uintptr_t));
     printf("Total Capacity: %" PRIu64 " bytes\n", total_size * sizeof(uintptr_t));
     printf("Num Regions: %i\n", num_regions);
+
+    if (arena->pool || arena->borrowed_regions || arena->lent_regions) {
+        int pooled = 0;
+        for (curr = arena->pool; curr; curr = curr->next) {
+            pooled += 1;
+        }
+        printf("Regions Pooled: %i, Borrowed: %" PRIu32 ", Lent: %" PRIu32 "\n",
+            pooled, arena->borrowed_regions, arena->lent_regions);
+    }
 }
 
 #endif // ARENA_IMPLEMENTATION
@@ -12,3 +12,5 @@ FLAGS="-Wextra"
 bear -- clang "$test_file_paths_c" "$FLAGS" -o test_c
 
 bear -- clang++ "$test_file_paths_cpp" "$FLAGS" -o test_cpp
+
+bear --append -- clang "${PWD}/tools/arena_replay.c" "$FLAGS" -O2 -o arena_replay
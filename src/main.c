@@ -2,6 +2,7 @@
 #include "Arena.h"
 
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -178,6 +179,360 @@ void test_performance(uint32_t region_size)
     arena_free(arena);
 }
 
+// Share of region capacity that is neither handed out nor still ahead of
+// the arena in its current region.
+static double arena_waste_percent(Arena* arena)
+{
+    uint64_t capacity = 0;
+    uint64_t used = 0;
+    for (Region* reg = arena->start; reg; reg = reg->next) {
+        capacity += reg->capacity;
+        used += reg->data_count;
+        if (reg == arena->end) {
+            capacity -= reg->capacity - reg->data_count;
+        }
+    }
+    return capacity ? 100.0 * (double)(capacity - used) / (double)capacity : 0.0;
+}
+
+static double mixed_allocations_run(uint32_t region_size, int backfill, size_t count, double* waste, int* regions)
+{
+    Arena* arena = create_arena(region_size);
+    arena_set_backfill(arena, backfill);
+    srand(1234);
+
+    clock_t start = clock();
+    for (size_t i = 0; i < count; i++) {
+        size_t size = 8 + (rand() % 1016);
+        unsigned char* memory = arena_allocate(arena, size);
+        memory[0] = (unsigned char)i;
+    }
+    double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    *waste = arena_waste_percent(arena);
+    *regions = 0;
+    for (Region* reg = arena->start; reg; reg = reg->next) {
+        *regions += 1;
+    }
+    arena_free(arena);
+    return elapsed;
+}
+
+// Same 8 B - 1 KB mix as test_mixed_allocations, with and without tail backfill
+void compare_backfill()
+{
+    printf("\n=== Comparing region tail backfill on mixed allocations ===\n");
+
+    const size_t COUNT = 2000000;
+    const uint32_t sizes[3] = { 4 KB, 16 KB, 64 KB };
+    for (int i = 0; i < 3; i++) {
+        double waste_off, waste_on;
+        int regions_off, regions_on;
+        double time_off = mixed_allocations_run(sizes[i], 0, COUNT, &waste_off, &regions_off);
+        double time_on = mixed_allocations_run(sizes[i], 1, COUNT, &waste_on, &regions_on);
+        printf("%6" PRIu32 " byte regions: waste %.2f%% -> %.2f%%, regions %d -> %d, time %.3f -> %.3f seconds\n",
+            sizes[i], waste_off, waste_on, regions_off, regions_on, time_off, time_on);
+    }
+}
+
+typedef enum CallocMode {
+    CALLOC_LIBC,
+    CALLOC_MEMSET,
+    CALLOC_ARENA,
+    CALLOC_ARENA_RESET_ZEROED,
+} CallocMode;
+
+static double calloc_run(CallocMode mode, uint32_t block, uint32_t total, int rounds, uint64_t* checksum)
+{
+    uint32_t count = total / block;
+    void** blocks = malloc(count * sizeof(void*));
+    Arena* arena = create_mapped_arena(total);
+
+    clock_t start = clock();
+    for (int r = 0; r < rounds; r++) {
+        for (uint32_t i = 0; i < count; i++) {
+            unsigned char* p;
+            if (mode == CALLOC_LIBC) {
+                p = calloc(1, block);
+            } else if (mode == CALLOC_MEMSET) {
+                p = arena_allocate(arena, block);
+                memset(p, 0, block);
+            } else {
+                p = arena_calloc(arena, 1, block);
+            }
+            *checksum += p[block - 1];
+            p[0] = (unsigned char)r;
+            p[block - 1] = (unsigned char)i;
+            blocks[i] = p;
+        }
+        if (mode == CALLOC_LIBC) {
+            for (uint32_t i = 0; i < count; i++) {
+                free(blocks[i]);
+            }
+        } else if (mode == CALLOC_ARENA_RESET_ZEROED) {
+            arena_reset_zeroed(arena);
+        } else {
+            arena_reset(arena);
+        }
+    }
+    double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    arena_free(arena);
+    free(blocks);
+    return elapsed;
+}
+
+// Zeroed allocations filling 64 MB, then dropped, several times over. Only
+// the first round gets fresh pages, later ones reuse dirty memory.
+void compare_calloc()
+{
+    printf("\n=== Comparing arena_calloc with calloc and memset ===\n");
+
+    const uint32_t TOTAL = 64 MB;
+    const int ROUNDS = 20;
+    const uint32_t blocks[2] = { 4 KB, 1 MB };
+    uint64_t checksum = 0;
+
+    for (int b = 0; b < 2; b++) {
+        double libc = calloc_run(CALLOC_LIBC, blocks[b], TOTAL, ROUNDS, &checksum);
+        double memset_time = calloc_run(CALLOC_MEMSET, blocks[b], TOTAL, ROUNDS, &checksum);
+        double arena = calloc_run(CALLOC_ARENA, blocks[b], TOTAL, ROUNDS, &checksum);
+        double reset_zeroed = calloc_run(CALLOC_ARENA_RESET_ZEROED, blocks[b], TOTAL, ROUNDS, &checksum);
+        printf("%7" PRIu32 " byte blocks: calloc %.3f, arena_allocate + memset %.3f, arena_calloc %.3f, "
+               "arena_calloc + arena_reset_zeroed %.3f seconds\n",
+            blocks[b], libc, memset_time, arena, reset_zeroed);
+    }
+    printf("Checksum: %" PRIu64 " (expected 0)\n", checksum);
+}
+
+typedef enum ScrubMode {
+    SCRUB_NONE,
+    SCRUB_MEMSET,
+    SCRUB_SECURE,
+    SCRUB_DEFERRED,
+} ScrubMode;
+
+static double wall_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Each request decrypts a payload into its arena, serves lookups from a hot
+// table and drops the arena. Wall time, so a background scrubber is only
+// charged for slowing the serving thread down.
+static double scrub_run(ScrubMode mode, int requests, const uint64_t* table, uint32_t table_len, uint64_t* checksum)
+{
+    const uint32_t PAYLOAD = 32 MB;
+    const uint32_t CHUNK = 16 KB;
+
+    Arena* arena = create_arena(256 KB);
+    if (mode == SCRUB_SECURE) {
+        arena_set_secure(arena, ARENA_SECURE_SYNC);
+    } else if (mode == SCRUB_DEFERRED) {
+        arena_set_secure(arena, ARENA_SECURE_DEFERRED);
+    }
+
+    double start = wall_seconds();
+    for (int r = 0; r < requests; r++) {
+        for (uint32_t off = 0; off < PAYLOAD; off += CHUNK) {
+            uint64_t* chunk = arena_allocate(arena, CHUNK);
+            for (uint32_t i = 0; i < CHUNK / sizeof(uint64_t); i += 8) {
+                chunk[i] = (uint64_t)r * 31 + off + i;
+            }
+        }
+        uint64_t key = (uint64_t)r;
+        for (int i = 0; i < 200000; i++) {
+            key = table[(key * 0x9E3779B97F4A7C15ull >> 40) % table_len] + (uint64_t)i;
+        }
+        *checksum += key;
+
+        if (mode == SCRUB_MEMSET) {
+            for (Region* reg = arena->start; reg; reg = reg->next) {
+                memset(reg->data, 0, reg->data_count * sizeof(uintptr_t));
+            }
+        }
+        arena_reset(arena);
+    }
+    double elapsed = wall_seconds() - start;
+
+    arena_free(arena);
+#ifdef ARENA_SCRUB_THREAD
+    arena_scrub_wait();
+#endif
+    return elapsed;
+}
+
+void compare_secure_reset()
+{
+    printf("\n=== Comparing secure reset strategies ===\n");
+
+    const int REQUESTS = 100;
+    const uint32_t TABLE_LEN = (512 KB) / sizeof(uint64_t);
+    uint64_t* table = malloc(TABLE_LEN * sizeof(uint64_t));
+    for (uint32_t i = 0; i < TABLE_LEN; i++) {
+        table[i] = (uint64_t)i * 2654435761u;
+    }
+    uint64_t checksum = 0;
+
+    double none = scrub_run(SCRUB_NONE, REQUESTS, table, TABLE_LEN, &checksum);
+    double memset_time = scrub_run(SCRUB_MEMSET, REQUESTS, table, TABLE_LEN, &checksum);
+    double secure = scrub_run(SCRUB_SECURE, REQUESTS, table, TABLE_LEN, &checksum);
+    printf("Checksum: %" PRIu64 "\n", checksum);
+    printf("Time for %d requests, plain reset: %.3f seconds\n", REQUESTS, none);
+    printf("Time for %d requests, memset then reset: %.3f seconds\n", REQUESTS, memset_time);
+    printf("Time for %d requests, arena_reset_secure: %.3f seconds\n", REQUESTS, secure);
+#ifdef ARENA_SCRUB_THREAD
+    double deferred = scrub_run(SCRUB_DEFERRED, REQUESTS, table, TABLE_LEN, &checksum);
+    printf("Time for %d requests, deferred to the scrubber thread: %.3f seconds\n", REQUESTS, deferred);
+#endif
+    free(table);
+}
+
+// Decoding messages whose field sizes are known from the header
+void compare_batch_allocation()
+{
+    printf("\n=== Comparing arena_allocate_batch with single allocations ===\n");
+
+    const int MESSAGES = 5000000;
+    const size_t FIELDS = 8;
+    size_t sizes[8];
+    void* fields[8];
+    uint64_t checksum = 0;
+
+    Arena* arena = create_arena(1 MB);
+    clock_t single_start = clock();
+    for (int m = 0; m < MESSAGES; m++) {
+        for (size_t f = 0; f < FIELDS; f++) {
+            sizes[f] = 4 + ((m + f * 7) & 31);
+            fields[f] = arena_allocate(arena, (uint32_t)sizes[f]);
+            *(uint32_t*)fields[f] = (uint32_t)(m + f);
+        }
+        checksum += *(uint32_t*)fields[m % FIELDS];
+        if ((m & 0x3FF) == 0x3FF) {
+            arena_reset(arena);
+        }
+    }
+    double single_time = (double)(clock() - single_start) / CLOCKS_PER_SEC;
+
+    arena_reset(arena);
+    clock_t batch_start = clock();
+    for (int m = 0; m < MESSAGES; m++) {
+        for (size_t f = 0; f < FIELDS; f++) {
+            sizes[f] = 4 + ((m + f * 7) & 31);
+        }
+        arena_allocate_batch(arena, sizes, FIELDS, fields);
+        for (size_t f = 0; f < FIELDS; f++) {
+            *(uint32_t*)fields[f] = (uint32_t)(m + f);
+        }
+        checksum -= *(uint32_t*)fields[m % FIELDS];
+        if ((m & 0x3FF) == 0x3FF) {
+            arena_reset(arena);
+        }
+    }
+    double batch_time = (double)(clock() - batch_start) / CLOCKS_PER_SEC;
+    arena_free(arena);
+
+    printf("Checksum: %" PRIu64 " (expected 0)\n", checksum);
+    printf("Time for %d messages of %zu fields, single calls: %.3f seconds (%.0f messages/sec)\n",
+        MESSAGES, FIELDS, single_time, MESSAGES / single_time);
+    printf("Time for %d messages of %zu fields, batched: %.3f seconds (%.0f messages/sec)\n",
+        MESSAGES, FIELDS, batch_time, MESSAGES / batch_time);
+    printf("Batching is %.2fx %s\n",
+        single_time > batch_time ? single_time / batch_time : batch_time / single_time,
+        single_time > batch_time ? "faster" : "slower");
+}
+
+typedef struct MapResult {
+    struct MapResult* next;
+    uint64_t key;
+    double values[4];
+} MapResult;
+
+// A worker's share of the map phase, built in the worker's own arena.
+static MapResult* map_worker(Arena* arena, int worker, int count, MapResult** tail)
+{
+    MapResult* head = NULL;
+    *tail = NULL;
+    for (int i = 0; i < count; i++) {
+        MapResult* r = (MapResult*)arena_allocate(arena, sizeof(MapResult));
+        r->next = head;
+        r->key = (uint64_t)worker * count + i;
+        for (int v = 0; v < 4; v++) {
+            r->values[v] = (double)(r->key + v);
+        }
+        if (!head) {
+            *tail = r;
+        }
+        head = r;
+    }
+    return head;
+}
+
+static uint64_t sum_results(const MapResult* r)
+{
+    uint64_t sum = 0;
+    for (; r; r = r->next) {
+        sum += r->key;
+    }
+    return sum;
+}
+
+// Reduce phase of a parallel build: one owner ends up with every worker's
+// results, copied out of the workers' arenas or merged with them
+void compare_arena_merge()
+{
+    printf("\n=== Comparing arena_merge with copying results ===\n");
+
+    const int WORKERS = 8;
+    const int RESULTS = 500000;
+    Arena* workers[8];
+    MapResult* heads[8];
+    MapResult* tails[8];
+
+    for (int w = 0; w < WORKERS; w++) {
+        workers[w] = create_arena(1 MB);
+        heads[w] = map_worker(workers[w], w, RESULTS, &tails[w]);
+    }
+    clock_t copy_start = clock();
+    Arena* owner = create_arena(1 MB);
+    MapResult* copied = NULL;
+    for (int w = 0; w < WORKERS; w++) {
+        for (MapResult* r = heads[w]; r; r = r->next) {
+            MapResult* c = (MapResult*)arena_allocate(owner, sizeof(MapResult));
+            memcpy(c, r, sizeof(MapResult));
+            c->next = copied;
+            copied = c;
+        }
+        arena_free(workers[w]);
+    }
+    double copy_time = (double)(clock() - copy_start) / CLOCKS_PER_SEC;
+    uint64_t copy_sum = sum_results(copied);
+    arena_free(owner);
+
+    for (int w = 0; w < WORKERS; w++) {
+        workers[w] = create_arena(1 MB);
+        heads[w] = map_worker(workers[w], w, RESULTS, &tails[w]);
+    }
+    clock_t merge_start = clock();
+    owner = create_arena(1 MB);
+    MapResult* merged = NULL;
+    for (int w = 0; w < WORKERS; w++) {
+        arena_merge(owner, workers[w]);
+        tails[w]->next = merged;
+        merged = heads[w];
+    }
+    double merge_time = (double)(clock() - merge_start) / CLOCKS_PER_SEC;
+    uint64_t merge_sum = sum_results(merged);
+    arena_free(owner);
+
+    printf("Sums: %" PRIu64 " / %" PRIu64 "\n", copy_sum, merge_sum);
+    printf("Time to gather %d results from %d arenas by copying: %.6f seconds\n", WORKERS * RESULTS, WORKERS, copy_time);
+    printf("Time to gather %d results from %d arenas with arena_merge: %.6f seconds\n", WORKERS * RESULTS, WORKERS, merge_time);
+    printf("Merging is %.0fx faster\n", merge_time > 0 ? copy_time / merge_time : 0.0);
+}
+
 // Test comparison with standard malloc
 void compare_with_malloc()
 {
@@ -225,6 +580,671 @@ void compare_with_malloc()
         malloc_time > arena_time ? "faster" : "slower");
 }
 
+// Rebuilding a large pointer-linked lookup table vs restoring it from a snapshot
+#ifndef SNAPSHOT_BENCH_BYTES
+#define SNAPSHOT_BENCH_BYTES (1024ull MB)
+#endif
+
+typedef struct LookupNode {
+    uint64_t key;
+    uint64_t value;
+    struct LookupNode* next;
+    char payload[40];
+} LookupNode;
+
+typedef struct LookupTable {
+    uint64_t num_buckets;
+    LookupNode** buckets;
+} LookupTable;
+
+static uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+static LookupTable* build_lookup_table(Arena* arena, uint64_t num_nodes)
+{
+    LookupTable* table = arena_allocate(arena, sizeof(LookupTable));
+    table->num_buckets = num_nodes;
+    table->buckets = arena_allocate(arena, (uint32_t)(num_nodes * sizeof(LookupNode*)));
+    memset(table->buckets, 0, num_nodes * sizeof(LookupNode*));
+
+    for (uint64_t i = 0; i < num_nodes; i++) {
+        LookupNode* node = arena_allocate(arena, sizeof(LookupNode));
+        node->key = mix64(i);
+        node->value = mix64(node->key);
+        snprintf(node->payload, sizeof(node->payload), "node-%" PRIu64, i);
+        uint64_t b = node->key % table->num_buckets;
+        node->next = table->buckets[b];
+        table->buckets[b] = node;
+    }
+    return table;
+}
+
+static uint64_t probe_lookup_table(LookupTable* table, uint64_t num_nodes)
+{
+    uint64_t found = 0;
+    for (uint64_t i = 0; i < num_nodes; i += 1009) {
+        uint64_t key = mix64(i);
+        for (LookupNode* node = table->buckets[key % table->num_buckets]; node; node = node->next) {
+            if (node->key == key && node->value == mix64(key)) {
+                found += 1;
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+void compare_snapshot_restore()
+{
+    printf("\n=== Comparing rebuild with snapshot restore (%llu MB) ===\n", SNAPSHOT_BENCH_BYTES / (1 MB));
+
+    const char* path = "/tmp/stam_snapshot_bench.bin";
+    uint64_t num_nodes = SNAPSHOT_BENCH_BYTES / (sizeof(LookupNode) + sizeof(LookupNode*));
+    uint64_t expected = (num_nodes + 1008) / 1009;
+
+    clock_t build_start = clock();
+    Arena* arena = create_arena(64 MB);
+    LookupTable* table = build_lookup_table(arena, num_nodes);
+    uint64_t found = probe_lookup_table(table, num_nodes);
+    double build_time = (double)(clock() - build_start) / CLOCKS_PER_SEC;
+
+    clock_t snapshot_start = clock();
+    if (arena_snapshot(arena, table, path) != 0) {
+        arena_free(arena);
+        return;
+    }
+    double snapshot_time = (double)(clock() - snapshot_start) / CLOCKS_PER_SEC;
+    arena_free(arena);
+
+    clock_t restore_start = clock();
+    void* root = NULL;
+    Arena* restored = arena_restore(path, &root);
+    if (!restored) {
+        return;
+    }
+    uint64_t restored_found = probe_lookup_table(root, num_nodes);
+    double restore_time = (double)(clock() - restore_start) / CLOCKS_PER_SEC;
+
+    print_arena(restored);
+    arena_free(restored);
+    remove(path);
+
+    printf("Lookups found: %" PRIu64 " rebuilt, %" PRIu64 " restored (expected %" PRIu64 ")\n", found, restored_found, expected);
+    printf("Rebuild: %.3f seconds\n", build_time);
+    printf("Snapshot write: %.3f seconds\n", snapshot_time);
+    printf("Restore: %.3f seconds\n", restore_time);
+    printf("Restore is %.2fx %s than rebuild\n",
+        build_time > restore_time ? build_time / restore_time : restore_time / build_time,
+        build_time > restore_time ? "faster" : "slower");
+}
+
+// Speculative work on a copy of a large arena: copy-on-write fork vs deep copy
+void compare_fork_with_copy()
+{
+    printf("\n=== Comparing arena_fork with deep copy ===\n");
+
+    const uint32_t REGION_SIZE = 16 MB - 64;
+    const int NUM_REGIONS = 4;
+
+    Arena* arena = create_forkable_arena(REGION_SIZE);
+    char* blocks[NUM_REGIONS];
+    for (int i = 0; i < NUM_REGIONS; i++) {
+        blocks[i] = arena_allocate(arena, REGION_SIZE - 64);
+        memset(blocks[i], i + 1, REGION_SIZE - 64);
+    }
+
+    clock_t copy_start = clock();
+    Arena* copy = create_arena(REGION_SIZE);
+    char* copies[NUM_REGIONS];
+    for (int i = 0; i < NUM_REGIONS; i++) {
+        copies[i] = arena_allocate(copy, REGION_SIZE - 64);
+        memcpy(copies[i], blocks[i], REGION_SIZE - 64);
+    }
+    copies[0][0] = 42;
+    arena_free(copy);
+    double copy_time = (double)(clock() - copy_start) / CLOCKS_PER_SEC;
+
+    clock_t fork_start = clock();
+    Arena* child = arena_fork(arena);
+    ((char*)child->start->data)[(char*)blocks[0] - (char*)arena->start->data] = 42;
+    arena_free(child);
+    double fork_time = (double)(clock() - fork_start) / CLOCKS_PER_SEC;
+
+    printf("Parent still holds %d (expected 1)\n", blocks[0][0]);
+    printf("Deep copy of %d MB: %.6f seconds\n", NUM_REGIONS * (int)(REGION_SIZE / (1 MB)), copy_time);
+    printf("arena_fork of %d MB: %.6f seconds\n", NUM_REGIONS * (int)(REGION_SIZE / (1 MB)), fork_time);
+    arena_free(arena);
+}
+
+// Simulation tick loop where every entity state lives for this tick and the next
+typedef struct EntityState {
+    double position[3];
+    double velocity[3];
+    struct EntityState* previous;
+    uint64_t tick;
+} EntityState;
+
+void compare_frame_arena_with_malloc()
+{
+    printf("\n=== Comparing FrameArena with malloc/free per tick ===\n");
+
+    const int NUM_TICKS = 2000;
+    const int NUM_ENTITIES = 5000;
+    const int NUM_EVENTS = 2000;
+
+    double checksum = 0;
+    EntityState** prev_states = malloc(NUM_ENTITIES * sizeof(EntityState*));
+    EntityState** states = malloc(NUM_ENTITIES * sizeof(EntityState*));
+    void** prev_events = malloc(NUM_EVENTS * sizeof(void*));
+    void** events = malloc(NUM_EVENTS * sizeof(void*));
+
+    // malloc: everything from two ticks ago has to be freed one by one
+    clock_t malloc_start = clock();
+    memset(prev_states, 0, NUM_ENTITIES * sizeof(EntityState*));
+    memset(prev_events, 0, NUM_EVENTS * sizeof(void*));
+    for (int t = 0; t < NUM_TICKS; t++) {
+        for (int i = 0; i < NUM_ENTITIES; i++) {
+            EntityState* s = malloc(sizeof(EntityState));
+            EntityState* p = prev_states[i];
+            for (int d = 0; d < 3; d++) {
+                s->velocity[d] = p ? p->velocity[d] * 0.99 : (double)(i % 7);
+                s->position[d] = (p ? p->position[d] : 0.0) + s->velocity[d];
+            }
+            s->previous = p;
+            s->tick = t;
+            states[i] = s;
+        }
+        for (int i = 0; i < NUM_EVENTS; i++) {
+            events[i] = malloc(16 + (i % 8) * 24);
+        }
+        for (int i = 0; i < NUM_ENTITIES; i++) {
+            if (prev_states[i]) {
+                free(prev_states[i]->previous);
+            }
+        }
+        for (int i = 0; i < NUM_EVENTS; i++) {
+            free(prev_events[i]);
+        }
+        EntityState** tmp_states = prev_states;
+        prev_states = states;
+        states = tmp_states;
+        void** tmp_events = prev_events;
+        prev_events = events;
+        events = tmp_events;
+        checksum += prev_states[t % NUM_ENTITIES]->position[0];
+    }
+    for (int i = 0; i < NUM_ENTITIES; i++) {
+        free(prev_states[i]->previous);
+        free(prev_states[i]);
+    }
+    for (int i = 0; i < NUM_EVENTS; i++) {
+        free(prev_events[i]);
+    }
+    double malloc_time = (double)(clock() - malloc_start) / CLOCKS_PER_SEC;
+
+    // FrameArena: two frames keep last tick's states alive, advance drops the rest
+    clock_t frame_start = clock();
+    FrameArena* frame = create_frame_arena(2, 1 MB);
+    memset(prev_states, 0, NUM_ENTITIES * sizeof(EntityState*));
+    for (int t = 0; t < NUM_TICKS; t++) {
+        for (int i = 0; i < NUM_ENTITIES; i++) {
+            EntityState* s = frame_arena_allocate(frame, sizeof(EntityState));
+            EntityState* p = prev_states[i];
+            for (int d = 0; d < 3; d++) {
+                s->velocity[d] = p ? p->velocity[d] * 0.99 : (double)(i % 7);
+                s->position[d] = (p ? p->position[d] : 0.0) + s->velocity[d];
+            }
+            s->previous = p;
+            s->tick = t;
+            states[i] = s;
+        }
+        for (int i = 0; i < NUM_EVENTS; i++) {
+            events[i] = frame_arena_allocate(frame, 16 + (i % 8) * 24);
+        }
+        EntityState** tmp_states = prev_states;
+        prev_states = states;
+        states = tmp_states;
+        checksum -= prev_states[t % NUM_ENTITIES]->position[0];
+        frame_arena_advance(frame);
+    }
+    frame_arena_free(frame);
+    double frame_time = (double)(clock() - frame_start) / CLOCKS_PER_SEC;
+
+    free(prev_states);
+    free(states);
+    free(prev_events);
+    free(events);
+
+    printf("Checksum: %f (expected 0)\n", checksum);
+    printf("Time for %d ticks with malloc/free: %.3f seconds (%.0f ticks/sec)\n",
+        NUM_TICKS, malloc_time, NUM_TICKS / malloc_time);
+    printf("Time for %d ticks with FrameArena: %.3f seconds (%.0f ticks/sec)\n",
+        NUM_TICKS, frame_time, NUM_TICKS / frame_time);
+    printf("FrameArena is %.2fx %s than malloc\n",
+        malloc_time > frame_time ? malloc_time / frame_time : frame_time / malloc_time,
+        malloc_time > frame_time ? "faster" : "slower");
+}
+
+// Small arenas made and dropped right away. Two mallocs is how create_arena
+// worked before the header moved into the first region's block.
+void compare_arena_creation()
+{
+    printf("\n=== Comparing creation and destruction of small arenas ===\n");
+
+    const int ROUNDS = 2000000;
+    const uint32_t SIZE = 1 KB;
+    uint64_t checksum = 0;
+
+    clock_t start = clock();
+    for (int r = 0; r < ROUNDS; r++) {
+        Arena* arena = malloc(sizeof(Arena));
+        arena_init(arena, SIZE);
+        uint64_t* v = arena_allocate(arena, sizeof(uint64_t));
+        *v = (uint64_t)r;
+        checksum += *v;
+        arena_free(arena);
+        free(arena);
+    }
+    double two_mallocs = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+    for (int r = 0; r < ROUNDS; r++) {
+        Arena* arena = create_arena(SIZE);
+        uint64_t* v = arena_allocate(arena, sizeof(uint64_t));
+        *v = (uint64_t)r;
+        checksum -= *v;
+        arena_free(arena);
+    }
+    double create_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+    for (int r = 0; r < ROUNDS; r++) {
+        Arena arena;
+        arena_init(&arena, SIZE);
+        uint64_t* v = arena_allocate(&arena, sizeof(uint64_t));
+        *v = (uint64_t)r;
+        checksum += *v;
+        arena_free(&arena);
+    }
+    double init_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+    for (int r = 0; r < ROUNDS; r++) {
+        uintptr_t buf[SIZE / sizeof(uintptr_t)];
+        Arena arena;
+        arena_init_from_buffer(&arena, buf, sizeof(buf));
+        uint64_t* v = arena_allocate(&arena, sizeof(uint64_t));
+        *v = (uint64_t)r;
+        checksum -= *v;
+        arena_free(&arena);
+    }
+    double buffer_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("Checksum: %" PRIu64 " (expected 0)\n", checksum);
+    printf("Header and region malloc'd separately: %.3f seconds (%.0f arenas/sec)\n", two_mallocs, ROUNDS / two_mallocs);
+    printf("create_arena: %.3f seconds (%.0f arenas/sec)\n", create_time, ROUNDS / create_time);
+    printf("arena_init on the stack: %.3f seconds (%.0f arenas/sec)\n", init_time, ROUNDS / init_time);
+    printf("arena_init_from_buffer: %.3f seconds (%.0f arenas/sec)\n", buffer_time, ROUNDS / buffer_time);
+    printf("create_arena is %.2fx %s than two mallocs\n",
+        two_mallocs > create_time ? two_mallocs / create_time : create_time / two_mallocs,
+        two_mallocs > create_time ? "faster" : "slower");
+}
+
+typedef struct LiveNode {
+    struct LiveNode* next;
+    uint64_t value;
+} LiveNode;
+
+static void trace_live_node(ArenaCompact* compact, void* obj)
+{
+    arena_compact_visit(compact, (void**)&((LiveNode*)obj)->next, sizeof(LiveNode), trace_live_node);
+}
+
+static void visit_live_list(ArenaCompact* compact)
+{
+    arena_compact_visit(compact, (void**)compact->user, sizeof(LiveNode), trace_live_node);
+}
+
+static uint64_t sum_live_list(const LiveNode* node)
+{
+    uint64_t sum = 0;
+    for (; node; node = node->next) {
+        sum += node->value;
+    }
+    return sum;
+}
+
+// A long lived list whose nodes were allocated among short lived garbage and
+// linked in no particular order, walked before and after arena_compact
+void compare_arena_compact()
+{
+    printf("\n=== Comparing traversal before and after arena_compact ===\n");
+
+    const uint64_t NODES = 2000000;
+    const int WALKS = 10;
+    Arena* arena = create_arena(4 MB);
+    LiveNode** nodes = (LiveNode**)malloc(NODES * sizeof(LiveNode*));
+    for (uint64_t i = 0; i < NODES; i++) {
+        arena_allocate(arena, 16 + mix64(i) % 240);
+        nodes[i] = (LiveNode*)arena_allocate(arena, sizeof(LiveNode));
+        nodes[i]->value = i;
+    }
+    for (uint64_t i = NODES - 1; i > 0; i--) {
+        uint64_t j = mix64(i ^ 0x5bd1e995) % (i + 1);
+        LiveNode* tmp = nodes[i];
+        nodes[i] = nodes[j];
+        nodes[j] = tmp;
+    }
+    for (uint64_t i = 0; i < NODES; i++) {
+        nodes[i]->next = i + 1 < NODES ? nodes[i + 1] : NULL;
+    }
+    LiveNode* head = nodes[0];
+    free(nodes);
+
+    uint64_t scattered_sum = 0;
+    clock_t scattered_start = clock();
+    for (int w = 0; w < WALKS; w++) {
+        scattered_sum += sum_live_list(head);
+    }
+    double scattered_time = (double)(clock() - scattered_start) / CLOCKS_PER_SEC;
+    uint64_t scattered_bytes = 0;
+    for (Region* r = arena->start; r; r = r->next) {
+        scattered_bytes += (uint64_t)r->data_count * sizeof(uintptr_t);
+    }
+
+    Arena* compacted = create_arena(4 MB);
+    clock_t compact_start = clock();
+    int64_t copied = arena_compact(arena, compacted, ARENA_COMPACT_DFS, visit_live_list, &head);
+    double compact_time = (double)(clock() - compact_start) / CLOCKS_PER_SEC;
+    uint64_t compacted_bytes = 0;
+    for (Region* r = compacted->start; r; r = r->next) {
+        compacted_bytes += (uint64_t)r->data_count * sizeof(uintptr_t);
+    }
+
+    uint64_t compacted_sum = 0;
+    clock_t compacted_start = clock();
+    for (int w = 0; w < WALKS; w++) {
+        compacted_sum += sum_live_list(head);
+    }
+    double compacted_time = (double)(clock() - compacted_start) / CLOCKS_PER_SEC;
+    arena_free(arena);
+    arena_free(compacted);
+
+    printf("Sums: %" PRIu64 " / %" PRIu64 "\n", scattered_sum, compacted_sum);
+    printf("Live data: %" PRIu64 " MB scattered over %" PRIu64 " MB, %" PRIu64 " MB after compaction\n",
+        NODES * sizeof(LiveNode) / (1 MB), scattered_bytes / (1 MB), compacted_bytes / (1 MB));
+    printf("arena_compact copied %" PRId64 " objects in %.3f seconds\n", copied, compact_time);
+    printf("Time for %d walks of %" PRIu64 " nodes, scattered: %.3f seconds\n", WALKS, NODES, scattered_time);
+    printf("Time for %d walks of %" PRIu64 " nodes, compacted: %.3f seconds\n", WALKS, NODES, compacted_time);
+    printf("Compacted walks are %.2fx faster\n", compacted_time > 0 ? scattered_time / compacted_time : 0.0);
+}
+
+// A snapshot readers walk without locks while the writer replaces it
+typedef struct EpochNode {
+    struct EpochNode* next;
+    uint64_t value;
+} EpochNode;
+
+typedef struct EpochBench {
+    EpochArena* epochs;
+    EpochNode* root;
+    int stop;
+    uint64_t reads;
+    uint64_t checksum;
+} EpochBench;
+
+static void* epoch_reader(void* arg)
+{
+    EpochBench* bench = (EpochBench*)arg;
+    int reader = epoch_arena_register(bench->epochs);
+    uint64_t reads = 0;
+    uint64_t sum = 0;
+    while (!__atomic_load_n(&bench->stop, __ATOMIC_RELAXED)) {
+        epoch_arena_pin(bench->epochs, reader);
+        EpochNode* root = __atomic_load_n(&bench->root, __ATOMIC_ACQUIRE);
+        for (EpochNode* n = root; n; n = n->next) {
+            sum += n->value;
+        }
+        epoch_arena_unpin(bench->epochs, reader);
+        // Spins before the first snapshot is published are not reads.
+        reads += root != NULL;
+    }
+    epoch_arena_unregister(bench->epochs, reader);
+    __atomic_fetch_add(&bench->reads, reads, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&bench->checksum, sum, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+static EpochNode* build_epoch_snapshot(EpochArena* epochs, int nodes, uint64_t version)
+{
+    EpochNode* head = NULL;
+    for (int i = 0; i < nodes; i++) {
+        EpochNode* n = epochs ? (EpochNode*)epoch_arena_allocate(epochs, sizeof(EpochNode))
+                              : (EpochNode*)malloc(sizeof(EpochNode));
+        n->value = version + i;
+        n->next = head;
+        head = n;
+    }
+    return head;
+}
+
+static void free_epoch_snapshots(EpochNode** retired, int count)
+{
+    for (int i = 0; i < count; i++) {
+        EpochNode* n = retired[i];
+        while (n) {
+            EpochNode* next = n->next;
+            free(n);
+            n = next;
+        }
+    }
+}
+
+// Writer publishes a new snapshot per epoch while readers walk the current
+// one. Both sides use the same epochs, only reclamation differs: malloc'd
+// nodes are retired and freed one by one, arena nodes go with one reset.
+static double run_epoch_bench(int use_arena, int readers, int versions, int nodes, uint64_t* reads)
+{
+    EpochBench bench = { create_epoch_arena(64 KB), NULL, 0, 0, 0 };
+    EpochNode** retired[EPOCH_ARENA_EPOCHS];
+    int num_retired[EPOCH_ARENA_EPOCHS] = { 0 };
+    for (int e = 0; e < EPOCH_ARENA_EPOCHS; e++) {
+        retired[e] = (EpochNode**)malloc(versions * sizeof(EpochNode*));
+    }
+    pthread_t threads[16];
+    for (int t = 0; t < readers; t++) {
+        pthread_create(&threads[t], NULL, epoch_reader, &bench);
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int v = 0; v < versions; v++) {
+        EpochNode* old = bench.root;
+        __atomic_store_n(&bench.root, build_epoch_snapshot(use_arena ? bench.epochs : NULL, nodes, v), __ATOMIC_RELEASE);
+        if (!use_arena && old) {
+            int e = bench.epochs->epoch % EPOCH_ARENA_EPOCHS;
+            retired[e][num_retired[e]++] = old;
+        }
+        // A reader still in the previous epoch keeps this one open, the next
+        // snapshots go to the same arena until it moves on.
+        if (epoch_arena_advance(bench.epochs) && !use_arena) {
+            int e = bench.epochs->epoch % EPOCH_ARENA_EPOCHS;
+            free_epoch_snapshots(retired[e], num_retired[e]);
+            num_retired[e] = 0;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    __atomic_store_n(&bench.stop, 1, __ATOMIC_RELAXED);
+    for (int t = 0; t < readers; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    for (int e = 0; e < EPOCH_ARENA_EPOCHS; e++) {
+        if (!use_arena) {
+            free_epoch_snapshots(retired[e], num_retired[e]);
+        }
+        free(retired[e]);
+    }
+    if (!use_arena) {
+        free_epoch_snapshots(&bench.root, 1);
+    }
+    epoch_arena_free(bench.epochs);
+    *reads = bench.reads;
+    return (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+void compare_epoch_arena()
+{
+    printf("\n=== Comparing epoch reclamation: per-node free vs epoch arenas ===\n");
+
+    const int READERS = 4;
+    const int VERSIONS = 2000;
+    const int NODES = 5000;
+    uint64_t free_reads = 0;
+    uint64_t arena_reads = 0;
+    double free_time = run_epoch_bench(0, READERS, VERSIONS, NODES, &free_reads);
+    double arena_time = run_epoch_bench(1, READERS, VERSIONS, NODES, &arena_reads);
+
+    printf("%d snapshots of %d nodes published under %d readers\n", VERSIONS, NODES, READERS);
+    printf("malloc + per-node free: %.3f seconds (%" PRIu64 " reads)\n", free_time, free_reads);
+    printf("Epoch arenas: %.3f seconds (%" PRIu64 " reads)\n", arena_time, arena_reads);
+    printf("Epoch arenas are %.2fx %s\n",
+        free_time > arena_time ? free_time / arena_time : arena_time / free_time,
+        free_time > arena_time ? "faster" : "slower");
+}
+
+#ifdef ARENA_REGION_CACHE
+// Short lived arenas of a few sizes with several alive at once, like one per
+// in flight request. Regions this size come from mmap in glibc, so without
+// the cache most arenas pay for a map, page faults and an unmap.
+#define CHURN_LIVE 8
+
+static double region_churn(int rounds, uint64_t* checksum)
+{
+    const uint32_t sizes[4] = { 256 KB, 1 MB, 512 KB, 4 MB };
+    Arena* live[CHURN_LIVE] = { 0 };
+
+    clock_t start = clock();
+    for (int r = 0; r < rounds; r++) {
+        int slot = r % CHURN_LIVE;
+        if (live[slot]) {
+            arena_free(live[slot]);
+        }
+        Arena* arena = create_arena(sizes[r % 4]);
+        for (int i = 0; i < 64; i++) {
+            uint64_t* block = arena_allocate(arena, 4 KB);
+            block[0] = (uint64_t)r + i;
+            *checksum += block[0];
+        }
+        live[slot] = arena;
+    }
+    for (int i = 0; i < CHURN_LIVE; i++) {
+        if (live[i]) {
+            arena_free(live[i]);
+        }
+    }
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+void compare_region_cache()
+{
+    printf("\n=== Comparing arena churn with and without the region cache ===\n");
+
+    const int ROUNDS = 500000;
+    uint64_t uncached_sum = 0;
+    uint64_t cached_sum = 0;
+
+    arena_region_cache_set_limit(0);
+    double uncached = region_churn(ROUNDS, &uncached_sum);
+
+    arena_region_cache_set_limit(ARENA_REGION_CACHE_LIMIT);
+    double cached = region_churn(ROUNDS, &cached_sum);
+    arena_region_cache_trim();
+
+    printf("Checksums: %" PRIu64 " / %" PRIu64 "\n", uncached_sum, cached_sum);
+    printf("Time for %d arenas without cache: %.3f seconds (%.0f arenas/sec)\n",
+        ROUNDS, uncached, ROUNDS / uncached);
+    printf("Time for %d arenas with cache: %.3f seconds (%.0f arenas/sec)\n",
+        ROUNDS, cached, ROUNDS / cached);
+    printf("Region cache is %.2fx %s\n",
+        uncached > cached ? uncached / cached : cached / uncached,
+        uncached > cached ? "faster" : "slower");
+}
+#endif
+
+#ifdef ARENA_PAGE_MAP
+// Membership by walking the region list, the only way without the page map.
+static int arena_owns_by_walk(Arena* arena, const void* ptr)
+{
+    for (Region* reg = arena->start; reg; reg = reg->next) {
+        if ((const char*)ptr >= (const char*)reg->data && (const char*)ptr < (const char*)&reg->data[reg->capacity]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Ownership checks on pointers spread over an arena of thousands of regions,
+// half of them from a second arena
+void compare_arena_owns()
+{
+    printf("\n=== Comparing arena_owns with walking the region list ===\n");
+
+    const int REGIONS = 4096;
+    const int PTRS = 4096;
+    const int LOOKUPS = 2000000;
+
+    Arena* arena = create_arena(4 KB);
+    Arena* other = create_arena(4 KB);
+    void* ptrs[4096];
+    for (int i = 0; i < REGIONS; i++) {
+        void* mine = NULL;
+        void* theirs = NULL;
+        for (int j = 0; j < 39; j++) { // A region's worth
+            mine = arena_allocate(arena, 100);
+            theirs = arena_allocate(other, 100);
+        }
+        ptrs[i % PTRS] = i % 2 ? mine : theirs;
+    }
+
+    int walk_hits = 0;
+    uint64_t rng = 88172645463325252ull;
+    clock_t walk_start = clock();
+    for (int i = 0; i < LOOKUPS / 100; i++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        walk_hits += arena_owns_by_walk(arena, ptrs[rng % PTRS]);
+    }
+    double walk_time = (double)(clock() - walk_start) / CLOCKS_PER_SEC * 100;
+
+    int map_hits = 0;
+    rng = 88172645463325252ull;
+    clock_t map_start = clock();
+    for (int i = 0; i < LOOKUPS; i++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        map_hits += arena_owns(arena, ptrs[rng % PTRS]);
+    }
+    double map_time = (double)(clock() - map_start) / CLOCKS_PER_SEC;
+
+    arena_free(arena);
+    arena_free(other);
+
+    printf("Hits: %d of %d walked, %d of %d mapped\n", walk_hits, LOOKUPS / 100, map_hits, LOOKUPS);
+    printf("Time for %d lookups walking %d regions: %.3f seconds (extrapolated from 1%%)\n", LOOKUPS, REGIONS, walk_time);
+    printf("Time for %d lookups in the page map: %.3f seconds (%.0f lookups/sec)\n", LOOKUPS, map_time, LOOKUPS / map_time);
+    printf("Page map is %.0fx faster\n", walk_time / map_time);
+}
+#endif
+
 int do_tests()
 {
     printf("=== Arena Allocator Stress Test ===\n");
@@ -252,6 +1272,24 @@ int do_tests()
 
     // Compare with malloc
     compare_with_malloc();
+    compare_frame_arena_with_malloc();
+
+    compare_snapshot_restore();
+    compare_fork_with_copy();
+    compare_arena_creation();
+    compare_backfill();
+    compare_calloc();
+    compare_secure_reset();
+    compare_batch_allocation();
+    compare_arena_merge();
+    compare_arena_compact();
+    compare_epoch_arena();
+#ifdef ARENA_REGION_CACHE
+    compare_region_cache();
+#endif
+#ifdef ARENA_PAGE_MAP
+    compare_arena_owns();
+#endif
 
     printf("\n=== All tests completed ===\n");
     return 0;
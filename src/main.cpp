@@ -0,0 +1,467 @@
+#define ARENA_IMPLEMENTATION
+#define ARENA_CPP
+#include "Arena.h"
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+static double seconds_since(clock_t start)
+{
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void report(const char* name, int ops, double std_time, double arena_time)
+{
+    printf("%s with std: %.3f seconds (%.0f ops/sec)\n", name, std_time, ops / std_time);
+    printf("%s with arena: %.3f seconds (%.0f ops/sec)\n", name, arena_time, ops / arena_time);
+    printf("Arena is %.2fx %s than std\n",
+        std_time > arena_time ? std_time / arena_time : arena_time / std_time,
+        std_time > arena_time ? "faster" : "slower");
+}
+
+// Build log lines piece by piece, dropping a batch of lines at a time
+void compare_string_builder()
+{
+    printf("\n=== Comparing ArenaString with std::string ===\n");
+
+    const int NUM_LINES = 1000000;
+    const int BATCH = 1000;
+    size_t checksum = 0;
+
+    clock_t std_start = clock();
+    for (int i = 0; i < NUM_LINES; i++) {
+        std::string line;
+        line += "2024-01-01T00:00:00Z ";
+        line += "INFO ";
+        line += "request_id=";
+        line += std::to_string(i);
+        line += " path=/api/v1/items method=GET status=200";
+        checksum += line.size();
+    }
+    double std_time = seconds_since(std_start);
+
+    ArenaCPP arena(1 MB);
+    char number[16];
+    clock_t arena_start = clock();
+    for (int i = 0; i < NUM_LINES; i++) {
+        ArenaString line = arena_string_begin(arena.get(), 64);
+        arena_string_append_cstr(&line, "2024-01-01T00:00:00Z ");
+        arena_string_append_cstr(&line, "INFO ");
+        arena_string_append_cstr(&line, "request_id=");
+        arena_string_append(&line, number, (uint32_t)snprintf(number, sizeof(number), "%d", i));
+        arena_string_append_cstr(&line, " path=/api/v1/items method=GET status=200");
+        arena_string_end(&line);
+        checksum -= line.length;
+        if (i % BATCH == BATCH - 1) {
+            arena.reset();
+        }
+    }
+    double arena_time = seconds_since(arena_start);
+
+    printf("Checksum: %zu (expected 0)\n", checksum);
+    report("Building lines", NUM_LINES, std_time, arena_time);
+}
+
+// Deduplicate header-like keys drawn from a small vocabulary
+void compare_intern()
+{
+    printf("\n=== Comparing ArenaIntern with std::unordered_set<std::string> ===\n");
+
+    const int NUM_KEYS = 2000000;
+    const int DISTINCT = 5000;
+
+    char(*keys)[48] = (char(*)[48])malloc(DISTINCT * sizeof(*keys));
+    uint32_t* lengths = (uint32_t*)malloc(DISTINCT * sizeof(uint32_t));
+    for (int i = 0; i < DISTINCT; i++) {
+        lengths[i] = (uint32_t)snprintf(keys[i], sizeof(keys[i]), "x-custom-header-name-%d", i * 7919);
+    }
+
+    size_t std_distinct = 0;
+    clock_t std_start = clock();
+    {
+        std::unordered_set<std::string> set;
+        for (int i = 0; i < NUM_KEYS; i++) {
+            int k = (int)((i * 2654435761u) % DISTINCT);
+            set.insert(std::string(keys[k], lengths[k]));
+        }
+        std_distinct = set.size();
+    }
+    double std_time = seconds_since(std_start);
+
+    ArenaCPP arena(1 MB);
+    clock_t arena_start = clock();
+    ArenaIntern table;
+    arena_intern_init(&table, arena.get(), 64);
+    for (int i = 0; i < NUM_KEYS; i++) {
+        int k = (int)((i * 2654435761u) % DISTINCT);
+        arena_intern(&table, keys[k], lengths[k]);
+    }
+    size_t arena_distinct = table.count;
+    arena.reset();
+    double arena_time = seconds_since(arena_start);
+
+    printf("Distinct keys: %zu std, %zu arena\n", std_distinct, arena_distinct);
+    report("Interning keys", NUM_KEYS, std_time, arena_time);
+
+    free(keys);
+    free(lengths);
+}
+
+// Build and probe a per-request lookup table, dropping it after every request
+void compare_hash_map()
+{
+    printf("\n=== Comparing ArenaHashMap with std::unordered_map ===\n");
+
+    const int NUM_REQUESTS = 200;
+    const int NUM_KEYS = 10000;
+    const int OPS = NUM_REQUESTS * NUM_KEYS * 2;
+    uint64_t checksum = 0;
+
+    // Scattered ids looked up in a different order than they were inserted
+    uint64_t* keys = (uint64_t*)malloc(NUM_KEYS * sizeof(uint64_t));
+    for (int i = 0; i < NUM_KEYS; i++) {
+        uint64_t x = (uint64_t)i * 0x9E3779B97F4A7C15ull;
+        keys[i] = x ^ (x >> 31);
+    }
+#define LOOKUP_KEY(i) keys[((i) * 7919) % NUM_KEYS]
+
+    clock_t std_start = clock();
+    for (int r = 0; r < NUM_REQUESTS; r++) {
+        std::unordered_map<uint64_t, uint64_t> map;
+        for (int i = 0; i < NUM_KEYS; i++) {
+            map[keys[i]] = i;
+        }
+        for (int i = 0; i < NUM_KEYS; i++) {
+            checksum += map.find(LOOKUP_KEY(i))->second;
+        }
+    }
+    double std_time = seconds_since(std_start);
+
+    typedef std::pair<const uint64_t, uint64_t> Entry;
+    typedef std::unordered_map<uint64_t, uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>, ArenaAllocator<Entry>> ArenaUnorderedMap;
+
+    ArenaCPP arena(4 MB);
+    clock_t alloc_start = clock();
+    for (int r = 0; r < NUM_REQUESTS; r++) {
+        {
+            ArenaUnorderedMap map(0, std::hash<uint64_t>(), std::equal_to<uint64_t>(), arena.allocator<Entry>());
+            for (int i = 0; i < NUM_KEYS; i++) {
+                map[keys[i]] = i;
+            }
+            for (int i = 0; i < NUM_KEYS; i++) {
+                checksum -= map.find(LOOKUP_KEY(i))->second;
+            }
+        }
+        arena.reset();
+    }
+    double alloc_time = seconds_since(alloc_start);
+
+    clock_t arena_start = clock();
+    for (int r = 0; r < NUM_REQUESTS; r++) {
+        {
+            ArenaHashMap<uint64_t, uint64_t> map(arena.get());
+            for (int i = 0; i < NUM_KEYS; i++) {
+                map[keys[i]] = i;
+            }
+            for (int i = 0; i < NUM_KEYS; i++) {
+                checksum += *map.find(LOOKUP_KEY(i));
+            }
+        }
+        arena.reset();
+    }
+    double arena_time = seconds_since(arena_start);
+#undef LOOKUP_KEY
+
+    printf("Checksum: %" PRIu64 "\n", checksum);
+    printf("std::unordered_map with ArenaAllocator: %.3f seconds (%.0f ops/sec)\n", alloc_time, OPS / alloc_time);
+    report("Lookup tables", OPS, std_time, arena_time);
+
+    free(keys);
+}
+
+// Append request events, then walk them once, dropping the list per request
+void compare_chunk_list()
+{
+    printf("\n=== Comparing ArenaChunkList with std::deque ===\n");
+
+    struct Event {
+        uint64_t timestamp;
+        uint32_t kind;
+        uint32_t payload;
+    };
+
+    const int NUM_REQUESTS = 1000;
+    const int NUM_EVENTS = 10000;
+    const int OPS = NUM_REQUESTS * NUM_EVENTS;
+    uint64_t checksum = 0;
+
+    clock_t std_start = clock();
+    for (int r = 0; r < NUM_REQUESTS; r++) {
+        std::deque<Event> events;
+        for (int i = 0; i < NUM_EVENTS; i++) {
+            events.push_back(Event { (uint64_t)i, (uint32_t)(i & 7), (uint32_t)r });
+        }
+        for (const Event& e : events) {
+            checksum += e.timestamp + e.kind;
+        }
+    }
+    double std_time = seconds_since(std_start);
+
+    ArenaCPP arena(1 MB);
+    clock_t arena_start = clock();
+    for (int r = 0; r < NUM_REQUESTS; r++) {
+        {
+            ArenaChunkList<Event> events(arena.get(), 64);
+            for (int i = 0; i < NUM_EVENTS; i++) {
+                events.push_back(Event { (uint64_t)i, (uint32_t)(i & 7), (uint32_t)r });
+            }
+            for (const Event& e : events) {
+                checksum -= e.timestamp + e.kind;
+            }
+        }
+        arena.reset();
+    }
+    double arena_time = seconds_since(arena_start);
+
+    printf("Checksum: %" PRIu64 " (expected 0)\n", checksum);
+    report("Event lists", OPS, std_time, arena_time);
+}
+
+struct LockedCountedPolicy : ArenaDefaultPolicy {
+    typedef ArenaSpinLock Lock;
+    typedef ArenaCountStats Stats;
+};
+
+template <typename Policy>
+static double policy_arena_run(int ops, uint64_t* checksum)
+{
+    clock_t start = clock();
+    BasicArena<Policy> arena(1 MB);
+    for (int i = 0; i < ops; i++) {
+        uint64_t* v = arena.template allocate<uint64_t>();
+        *v = (uint64_t)i;
+        *checksum += *v;
+        if ((i & 0xFFFF) == 0xFFFF) {
+            arena.reset();
+        }
+    }
+    return seconds_since(start);
+}
+
+// Small allocations through the C call against the inlined policy fast path
+void compare_policy_arena()
+{
+    printf("\n=== Comparing arena_allocate with BasicArena policies ===\n");
+
+    const int OPS = 50000000;
+    uint64_t checksum = 0;
+
+    clock_t c_start = clock();
+    Arena* c_arena = create_arena(1 MB);
+    for (int i = 0; i < OPS; i++) {
+        uint64_t* v = (uint64_t*)arena_allocate(c_arena, sizeof(uint64_t));
+        *v = (uint64_t)i;
+        checksum += *v;
+        if ((i & 0xFFFF) == 0xFFFF) {
+            arena_reset(c_arena);
+        }
+    }
+    arena_free(c_arena);
+    double c_time = seconds_since(c_start);
+
+    double default_time = policy_arena_run<ArenaDefaultPolicy>(OPS, &checksum);
+    double locked_time = policy_arena_run<LockedCountedPolicy>(OPS, &checksum);
+
+    printf("Checksum: %" PRIu64 "\n", checksum);
+    printf("arena_allocate: %.3f seconds (%.0f ops/sec)\n", c_time, OPS / c_time);
+    printf("BasicArena<ArenaDefaultPolicy>: %.3f seconds (%.0f ops/sec)\n", default_time, OPS / default_time);
+    printf("BasicArena<spin lock + stats>: %.3f seconds (%.0f ops/sec)\n", locked_time, OPS / locked_time);
+    printf("Default policy is %.2fx %s than arena_allocate\n",
+        c_time > default_time ? c_time / default_time : default_time / c_time,
+        c_time > default_time ? "faster" : "slower");
+}
+
+struct Particle {
+    double x, y, z;
+    char name[32];
+    uint64_t id;
+};
+
+struct ParticleName {
+    char text[32];
+};
+
+// Sum three fields per row with the rows stored whole against column by column
+void compare_soa()
+{
+    printf("\n=== Comparing AoS rows with ArenaSoA columns ===\n");
+
+    const int N = 10000000;
+    const int PASSES = 10;
+
+    Arena* arena = create_arena(64 MB);
+    Particle* rows = (Particle*)arena_allocate_aligned(arena, N * sizeof(Particle), ARENA_SOA_ALIGN);
+    ArenaSoA<double, double, double, ParticleName, uint64_t> table(arena, N);
+    ParticleName name;
+    memset(&name, 0, sizeof(name));
+    for (int i = 0; i < N; i++) {
+        rows[i].x = i * 0.5;
+        rows[i].y = i * 0.25;
+        rows[i].z = i * 0.125;
+        rows[i].id = (uint64_t)i;
+        table.push_back(i * 0.5, i * 0.25, i * 0.125, name, (uint64_t)i);
+    }
+
+    double aos_sum = 0;
+    clock_t start = clock();
+    for (int pass = 0; pass < PASSES; pass++) {
+        for (int i = 0; i < N; i++) {
+            aos_sum += rows[i].x + rows[i].y + rows[i].z;
+        }
+    }
+    double aos_time = seconds_since(start);
+
+    double soa_sum = 0;
+    start = clock();
+    for (int pass = 0; pass < PASSES; pass++) {
+        ArenaSpan<double> xs = table.column<0>();
+        ArenaSpan<double> ys = table.column<1>();
+        ArenaSpan<double> zs = table.column<2>();
+        for (size_t i = 0; i < xs.size; i++) {
+            soa_sum += xs[i] + ys[i] + zs[i];
+        }
+    }
+    double soa_time = seconds_since(start);
+
+    arena_free(arena);
+
+    printf("Sums: %.0f / %.0f\n", aos_sum, soa_sum);
+    printf("AoS rows: %.3f seconds (%.0f rows/sec)\n", aos_time, N * PASSES / aos_time);
+    printf("ArenaSoA columns: %.3f seconds (%.0f rows/sec)\n", soa_time, N * PASSES / soa_time);
+    printf("Columns are %.2fx %s than rows\n",
+        aos_time > soa_time ? aos_time / soa_time : soa_time / aos_time,
+        aos_time > soa_time ? "faster" : "slower");
+}
+
+struct RawTreeNode {
+    RawTreeNode* left;
+    RawTreeNode* right;
+    uint64_t value;
+};
+
+struct SmallTreeNode {
+    ArenaPtr32<SmallTreeNode> left;
+    ArenaPtr32<SmallTreeNode> right;
+    uint64_t value;
+};
+
+static uint64_t raw_tree_sum(const RawTreeNode* node)
+{
+    uint64_t sum = 0;
+    while (node) {
+        sum += node->value + raw_tree_sum(node->left);
+        node = node->right;
+    }
+    return sum;
+}
+
+// Offsets are passed down as is and only decoded to read the node, testing
+// decoded pointers for null again costs a branch per child.
+static uint64_t small_tree_sum(const Arena* arena, ArenaPtr32<SmallTreeNode> node)
+{
+    uint64_t sum = 0;
+    while (node) {
+        const SmallTreeNode* n = node.get(arena);
+        sum += n->value + small_tree_sum(arena, n->left);
+        node = n->right;
+    }
+    return sum;
+}
+
+// Walk a complete binary tree whose nodes are placed in random order, with
+// 8-byte pointers against 4-byte ArenaPtr32 offsets
+void compare_compressed_pointers()
+{
+    printf("\n=== Comparing raw pointers with ArenaPtr32 ===\n");
+
+    const uint32_t N = 16000000;
+    const int PASSES = 5;
+
+    // Node i of the complete tree (children 2i+1, 2i+2) lives in slot order[i].
+    std::vector<uint32_t> order(N);
+    for (uint32_t i = 0; i < N; i++) {
+        order[i] = i;
+    }
+    uint64_t rng = 88172645463325252ull;
+    for (uint32_t i = N - 1; i > 0; i--) {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        std::swap(order[i], order[rng % (i + 1)]);
+    }
+
+    Arena* raw_arena = create_mapped_arena(N * sizeof(RawTreeNode) + 64);
+    RawTreeNode* raw = (RawTreeNode*)arena_allocate_aligned(raw_arena, N * sizeof(RawTreeNode), 64);
+    for (uint32_t i = 0; i < N; i++) {
+        RawTreeNode* node = &raw[order[i]];
+        node->left = 2 * i + 1 < N ? &raw[order[2 * i + 1]] : nullptr;
+        node->right = 2 * i + 2 < N ? &raw[order[2 * i + 2]] : nullptr;
+        node->value = i;
+    }
+
+    Arena* small_arena = create_reserved_arena(1 GB, N * sizeof(SmallTreeNode) + 64);
+    SmallTreeNode* small = (SmallTreeNode*)arena_allocate_aligned(small_arena, N * sizeof(SmallTreeNode), 64);
+    for (uint32_t i = 0; i < N; i++) {
+        SmallTreeNode* node = &small[order[i]];
+        node->left.set(small_arena, 2 * i + 1 < N ? &small[order[2 * i + 1]] : nullptr);
+        node->right.set(small_arena, 2 * i + 2 < N ? &small[order[2 * i + 2]] : nullptr);
+        node->value = i;
+    }
+
+    uint64_t raw_sum = 0;
+    clock_t start = clock();
+    for (int pass = 0; pass < PASSES; pass++) {
+        raw_sum += raw_tree_sum(&raw[order[0]]);
+    }
+    double raw_time = seconds_since(start);
+
+    uint64_t small_sum = 0;
+    start = clock();
+    for (int pass = 0; pass < PASSES; pass++) {
+        small_sum += small_tree_sum(small_arena, ArenaPtr32<SmallTreeNode>(small_arena, &small[order[0]]));
+    }
+    double small_time = seconds_since(start);
+
+    arena_free(raw_arena);
+    arena_free(small_arena);
+
+    printf("Sums: %" PRIu64 " / %" PRIu64 "\n", raw_sum, small_sum);
+    printf("Raw pointers (%zu byte nodes): %.3f seconds (%.0f nodes/sec)\n", sizeof(RawTreeNode), raw_time,
+        (double)N * PASSES / raw_time);
+    printf("ArenaPtr32 (%zu byte nodes): %.3f seconds (%.0f nodes/sec)\n", sizeof(SmallTreeNode), small_time,
+        (double)N * PASSES / small_time);
+    printf("Compressed pointers are %.2fx %s than raw pointers\n",
+        raw_time > small_time ? raw_time / small_time : small_time / raw_time,
+        raw_time > small_time ? "faster" : "slower");
+}
+
+int main()
+{
+    compare_string_builder();
+    compare_intern();
+    compare_hash_map();
+    compare_chunk_list();
+    compare_policy_arena();
+    compare_soa();
+    compare_compressed_pointers();
+
+    printf("\n=== All benchmarks completed ===\n");
+    return 0;
+}
@@ -1,6 +1,52 @@
 #define ARENA_IMPLEMENTATION
 #include "../Arena.h"
 #include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+typedef struct CompactLink {
+    struct CompactLink* next;
+    int value;
+} CompactLink;
+
+static void trace_compact_link(ArenaCompact* compact, void* obj)
+{
+    arena_compact_visit(compact, (void**)&((CompactLink*)obj)->next, sizeof(CompactLink), trace_compact_link);
+}
+
+typedef struct CompactRoots {
+    CompactLink* list;
+    int* inner; // Points into a link, so it is copied on its own
+} CompactRoots;
+
+static void visit_compact_roots(ArenaCompact* compact)
+{
+    CompactRoots* roots = (CompactRoots*)compact->user;
+    arena_compact_visit(compact, (void**)&roots->list, sizeof(CompactLink), trace_compact_link);
+    arena_compact_visit(compact, (void**)&roots->inner, sizeof(int), NULL);
+}
+
+#ifdef ARENA_REGION_CACHE
+static void* fill_region_cache(void* unused)
+{
+    (void)unused;
+    Arena* arenas[ARENA_REGION_CACHE_MAGAZINE];
+    for (int i = 0; i < ARENA_REGION_CACHE_MAGAZINE; i++) {
+        arenas[i] = create_arena(4 KB);
+    }
+    for (int i = 0; i < ARENA_REGION_CACHE_MAGAZINE; i++) {
+        arena_free(arenas[i]);
+    }
+    return NULL;
+}
+
+// Takes regions from the cache but never gives any back itself.
+static void* take_from_region_cache(void* unused)
+{
+    (void)unused;
+    return create_arena(4 KB);
+}
+#endif
 
 int main()
 {
@@ -29,12 +75,354 @@ int main()
         printf("Failed to allocate double\n");
     }
 
+    ArenaString str = arena_string_begin(arena, 4);
+    arena_string_append_cstr(&str, "Hello");
+    arena_string_appendf(&str, ", %s #%d", "arena", 1);
+    printf("Built string: %s\n", arena_string_end(&str));
+
+    ArenaIntern table;
+    arena_intern_init(&table, arena, 4);
+    const char* k1 = arena_intern_cstr(&table, "content-type");
+    const char* k2 = arena_intern_cstr(&table, "content-length");
+    const char* k3 = arena_intern_cstr(&table, "content-type");
+    printf("Interned: %s %s | same pointer: %s\n", k1, k2, (k1 == k3 && k1 != k2) ? "yes" : "no");
+
     print_arena(arena);
 
     arena_reset(arena);
     printf("Arena reset.\n");
     print_arena(arena);
 
+    // Spread a linked list over several regions, then snapshot and restore it
+    typedef struct Link {
+        struct Link* next;
+        int value;
+    } Link;
+    Link* head = NULL;
+    for (int i = 0; i < 200; i++) {
+        Link* link = (Link*)arena_allocate(arena, sizeof(Link));
+        link->value = i;
+        link->next = head;
+        head = link;
+    }
+    arena_snapshot(arena, head, "/tmp/stam_test_snapshot.bin");
+
+    void* root = NULL;
+    Arena* restored = arena_restore("/tmp/stam_test_snapshot.bin", &root);
+    int count = 0;
+    int sum = 0;
+    for (Link* link = (Link*)root; link; link = link->next) {
+        count += 1;
+        sum += link->value;
+    }
+    printf("Restored list: %d links, sum %d (expected 200, 19900)\n", count, sum);
+    print_arena(restored);
+    for (int i = 0; i < 1000; i++) {
+        arena_allocate(restored, sizeof(Link));
+    }
+    printf("Restored arena grows by regions as big as the original's: %s\n",
+        restored->last->capacity == arena->start->capacity ? "yes" : "no");
+    arena_free(restored);
+
+    // A region offset that wraps around the address space is refused
+    FILE* wrapped = fopen("/tmp/stam_test_snapshot.bin", "r+b");
+    ArenaSnapshotHeader wrapped_header;
+    ArenaSnapshotRegion wrapped_region;
+    fread(&wrapped_header, sizeof(wrapped_header), 1, wrapped);
+    fread(&wrapped_region, sizeof(wrapped_region), 1, wrapped);
+    wrapped_header.reloc_count = 0;
+    wrapped_header.root_offset = 0;
+    wrapped_region.file_offset = UINT64_MAX - 4095;
+    wrapped_region.data_count = 1000;
+    fseek(wrapped, 0, SEEK_SET);
+    fwrite(&wrapped_header, sizeof(wrapped_header), 1, wrapped);
+    fwrite(&wrapped_region, sizeof(wrapped_region), 1, wrapped);
+    fclose(wrapped);
+    printf("Wrapped snapshot refused: %s\n", arena_restore("/tmp/stam_test_snapshot.bin", &root) ? "no" : "yes");
+    remove("/tmp/stam_test_snapshot.bin");
+
+    // A one-past-end pointer is rebased too, and a damaged relocation table is refused
+    typedef struct Range {
+        int* begin;
+        int* end;
+    } Range;
+    Arena* ranges = create_arena(256);
+    Range* range = (Range*)arena_allocate(ranges, sizeof(Range));
+    range->begin = (int*)arena_allocate(ranges, 4 * sizeof(int));
+    range->end = range->begin + 4;
+    arena_snapshot(ranges, range, "/tmp/stam_test_range.bin");
+    arena_free(ranges);
+    Arena* restored_range = arena_restore("/tmp/stam_test_range.bin", &root);
+    Range* back = (Range*)root;
+    printf("Restored range: %d ints, end inside the restored region %s\n", (int)(back->end - back->begin),
+        (uintptr_t)back->end == (uintptr_t)&restored_range->start->data[restored_range->start->data_count] ? "yes" : "no");
+    arena_free(restored_range);
+
+    FILE* damaged = fopen("/tmp/stam_test_range.bin", "r+b");
+    ArenaSnapshotHeader range_header;
+    uint64_t bad_reloc = 1ull << 40;
+    fread(&range_header, sizeof(range_header), 1, damaged);
+    fseek(damaged, (long)range_header.reloc_offset, SEEK_SET);
+    fwrite(&bad_reloc, sizeof(bad_reloc), 1, damaged);
+    fclose(damaged);
+    printf("Damaged snapshot refused: %s\n", arena_restore("/tmp/stam_test_range.bin", &root) ? "no" : "yes");
+    remove("/tmp/stam_test_range.bin");
+
+    // Forked workers allocate into one shared arena, the parent reads the results
+    Arena* shared = create_shared_arena(NULL, 64 KB);
+    int** slots = (int**)arena_allocate(shared, 4 * sizeof(int*));
+    arena_shared_publish(shared, slots);
+    for (int w = 0; w < 4; w++) {
+        if (fork() == 0) {
+            int* value = (int*)arena_allocate_shared(shared, sizeof(int));
+            *value = w * 10;
+            ((int**)arena_shared_root(shared))[w] = value;
+            _exit(0);
+        }
+    }
+    while (wait(NULL) > 0) {
+    }
+    int shared_sum = 0;
+    for (int w = 0; w < 4; w++) {
+        shared_sum += *slots[w];
+    }
+    printf("Shared arena sum from 4 processes: %d (expected 60)\n", shared_sum);
+    arena_free(shared);
+
+    // A forked child sees the parent's data but its writes stay private
+    Arena* parent = create_forkable_arena(4 KB);
+    int* counter = (int*)arena_allocate(parent, sizeof(int));
+    *counter = 1;
+    Arena* child = arena_fork(parent);
+    int* child_counter = (int*)child->start->data + (counter - (int*)parent->start->data);
+    *child_counter += 41;
+    int* child_extra = (int*)arena_allocate(child, sizeof(int));
+    *child_extra = 7;
+    printf("Forked arena: child %d, parent %d (expected 42, 1), child regions %s\n",
+        *child_counter, *counter, child->start->next ? "grew" : "did not grow");
+    for (int i = 0; i < 1000; i++) {
+        arena_allocate(child, sizeof(int));
+    }
+    int child_regions = 0;
+    for (Region* reg = child->start; reg; reg = reg->next) {
+        child_regions += 1;
+    }
+    printf("Forked child regions after 1000 allocations: %d, sized like the parent's %s\n", child_regions,
+        child_regions < 10 ? "yes" : "no");
+    arena_free(child);
+    arena_free(parent);
+
+    // Each tick's data survives the next tick and is dropped on the one after
+    FrameArena* frames = create_frame_arena(2, 1 KB);
+    int* tick0 = (int*)frame_arena_allocate(frames, sizeof(int));
+    *tick0 = 100;
+    frame_arena_advance(frames);
+    int* tick1 = (int*)frame_arena_allocate(frames, sizeof(int));
+    *tick1 = *tick0 + 1;
+    frame_arena_advance(frames);
+    printf("Frame arena: tick1 %d, tick0 region used after two advances: %" PRIu32 " (expected 101, 0)\n",
+        *tick1, frames->arenas[0]->start->data_count);
+    frame_arena_free(frames);
+
+    // Nested scopes: regions go from request to transaction to statement and back
+    Arena* request = create_arena(4 KB);
+    for (int txn = 0; txn < 3; txn++) {
+        Arena* transaction = arena_create_child(request, 4 KB);
+        for (int stmt = 0; stmt < 3; stmt++) {
+            Arena* statement = arena_create_child(transaction, 4 KB);
+            arena_allocate(statement, 3 KB);
+            arena_allocate(statement, 3 KB);
+            arena_free(statement);
+        }
+        arena_free(transaction);
+    }
+    printf("Child arenas, request arena after 3 transactions of 3 statements:\n");
+    print_arena(request);
+    arena_free(request);
+
+    // A child that cannot get a region gives its header back to the parent
+    Arena* cramped = create_reserved_arena(64 KB, 1 KB);
+    uint32_t used_before = cramped->end->data_count;
+    Arena* too_big = arena_create_child(cramped, 1 MB);
+    printf("Child without a region: %s, parent usage unchanged %s\n", too_big ? "created" : "refused",
+        cramped->end->data_count == used_before ? "yes" : "no");
+    arena_free(cramped);
+
+    // Stack scratch: the first 1 KB never touches the heap
+    uintptr_t scratch_buf[128];
+    Arena scratch;
+    arena_init_from_buffer(&scratch, scratch_buf, sizeof(scratch_buf));
+    char* small = (char*)arena_allocate(&scratch, 256);
+    int on_stack = small >= (char*)scratch_buf && small < (char*)scratch_buf + sizeof(scratch_buf);
+    arena_allocate(&scratch, 900);
+    printf("Buffer arena: first allocation on stack %s, spilled to heap %s\n",
+        on_stack ? "yes" : "no", scratch.start->next ? "yes" : "no");
+    arena_free(&scratch);
+
+    // Backfill: a request that misses the current region uses an earlier tail
+    Arena* backfill = create_arena(1 KB);
+    arena_set_backfill(backfill, 1);
+    arena_allocate(backfill, 600);
+    arena_allocate(backfill, 1000);
+    char* tail = (char*)arena_allocate(backfill, 300);
+    printf("Backfill: 300 bytes went to the first region's tail %s\n",
+        tail > (char*)backfill->start->data && tail < (char*)&backfill->start->data[backfill->start->capacity] ? "yes" : "no");
+    arena_free(backfill);
+
+    // arena_calloc clears memory reused after a reset, and skips fresh pages
+    Arena* zeroed = create_mapped_arena(4 KB);
+    unsigned char* dirty = (unsigned char*)arena_calloc(zeroed, 100, 8);
+    int fresh_zero = dirty[0] == 0 && dirty[799] == 0;
+    memset(dirty, 0xFF, 800);
+    arena_reset(zeroed);
+    unsigned char* cleared = (unsigned char*)arena_calloc(zeroed, 200, 8);
+    int reused_zero = 1;
+    for (int i = 0; i < 1600; i++) {
+        reused_zero = reused_zero && cleared[i] == 0;
+    }
+    printf("arena_calloc: fresh zero %s, reused zero %s, zero mark past first use %s\n",
+        fresh_zero ? "yes" : "no", reused_zero ? "yes" : "no", zeroed->start->zero_mark >= 100 ? "yes" : "no");
+    arena_free(zeroed);
+
+    // Secure reset: the next allocation at the same address reads back zeroes
+    Arena* secrets = create_arena(1 KB);
+    char* password = (char*)arena_allocate(secrets, 32);
+    strcpy(password, "hunter2");
+    arena_reset_secure(secrets);
+    char* reused = (char*)arena_allocate(secrets, 32);
+    int wiped = reused == password;
+    for (int i = 0; i < 32; i++) {
+        wiped = wiped && reused[i] == 0;
+    }
+    printf("Secure reset wiped the secret: %s\n", wiped ? "yes" : "no");
+    arena_free(secrets);
+
+    // Batch: one bump for a whole decoded message
+    Arena* batch = create_arena(1 KB);
+    size_t field_sizes[4] = { 12, 40, 8, 100 };
+    void* fields[4];
+    int batched = arena_allocate_batch(batch, field_sizes, 4, fields) == 0;
+    for (int i = 0; i < 4; i++) {
+        memset(fields[i], i, field_sizes[i]);
+    }
+    printf("Batch allocation: %s, fields in order %s, region used %" PRIu32 " bytes\n",
+        batched ? "ok" : "failed",
+        fields[0] < fields[1] && fields[1] < fields[2] && fields[2] < fields[3] ? "yes" : "no",
+        batch->start->data_count * (uint32_t)sizeof(uintptr_t));
+    size_t huge_sizes[2] = { 16, SIZE_MAX - 3 };
+    printf("Batch with a size that wraps when aligned refused: %s\n",
+        arena_allocate_batch(batch, huge_sizes, 2, fields) == -1 ? "yes" : "no");
+    arena_free(batch);
+
+    // Merge: a worker's results outlive the worker arena without copying
+    Arena* owner = create_arena(1 KB);
+    Arena* worker = create_arena(256);
+    int* results[100];
+    for (int i = 0; i < 100; i++) {
+        results[i] = (int*)arena_allocate(worker, sizeof(int));
+        *results[i] = i;
+    }
+    int merged = arena_merge(owner, worker) == 0;
+    int* after = (int*)arena_allocate(owner, sizeof(int));
+    *after = -1;
+    int intact = 1;
+    for (int i = 0; i < 100; i++) {
+        intact = intact && *results[i] == i;
+    }
+    char merge_buf[512];
+    Arena buffered;
+    arena_init_from_buffer(&buffered, merge_buf, sizeof(merge_buf));
+    int refused = arena_merge(owner, &buffered) == -1;
+    Arena* secure_worker = create_arena(256);
+    arena_set_secure(secure_worker, ARENA_SECURE_SYNC);
+    int secure_refused = arena_merge(owner, secure_worker) == -1;
+    printf("Merge: %s, results intact %s, buffer-backed arena refused %s, secure into plain refused %s\n",
+        merged ? "ok" : "failed", intact ? "yes" : "no", refused ? "yes" : "no", secure_refused ? "yes" : "no");
+    arena_free(secure_worker);
+    print_arena(owner);
+    arena_free(&buffered);
+    arena_free(owner);
+
+    // Compaction: live links scattered between garbage end up together, in list order
+    Arena* scattered = create_arena(512);
+    Arena* compacted = create_arena(4 KB);
+    CompactLink* live = NULL;
+    for (int i = 0; i < 100; i++) {
+        arena_allocate(scattered, 200);
+        CompactLink* link = (CompactLink*)arena_allocate(scattered, sizeof(CompactLink));
+        link->value = i;
+        link->next = live;
+        live = link;
+    }
+    CompactRoots roots = { live, &live->next->value };
+    int self_refused = arena_compact(scattered, scattered, ARENA_COMPACT_DFS, visit_compact_roots, &roots) == -1;
+    int64_t copied = arena_compact(scattered, compacted, ARENA_COMPACT_DFS, visit_compact_roots, &roots);
+    live = roots.list;
+    int live_sum = 0;
+    int ascending = 1;
+    for (CompactLink* link = live; link; link = link->next) {
+        live_sum += link->value;
+        ascending = ascending && (!link->next || link->next > link);
+    }
+    printf("Compaction: %" PRId64 " objects, sum %d (expected 101, 4950), in address order %s, source reset %s\n",
+        copied, live_sum, ascending ? "yes" : "no", scattered->start->data_count == 0 ? "yes" : "no");
+    printf("Compaction: interior pointer copied apart %s (value %d, expected 98), into itself refused %s\n",
+        roots.inner != &live->next->value ? "yes" : "no", *roots.inner, self_refused ? "yes" : "no");
+    arena_free(scattered);
+    arena_free(compacted);
+
+    // Epochs: a pinned reader holds back reclamation of what it can see
+    EpochArena* epochs = create_epoch_arena(1 KB);
+    int reader = epoch_arena_register(epochs);
+    int* version0 = (int*)epoch_arena_allocate(epochs, sizeof(int));
+    *version0 = 7;
+    epoch_arena_pin(epochs, reader);
+    int first_advance = epoch_arena_advance(epochs);
+    int blocked = !epoch_arena_advance(epochs);
+    int survived = *version0 == 7 && epochs->arenas[0]->start->data_count > 0;
+    epoch_arena_unpin(epochs, reader);
+    int advanced = epoch_arena_advance(epochs) && epoch_arena_advance(epochs);
+    printf("Epoch arena: advance with reader in epoch %s, blocked behind it %s, data kept %s, "
+           "reclaimed at epoch %" PRIu64 " %s\n",
+        first_advance ? "yes" : "no", blocked ? "yes" : "no", survived ? "yes" : "no", epochs->epoch,
+        advanced && epochs->arenas[0]->start->data_count == 0 ? "yes" : "no");
+    epoch_arena_unregister(epochs, reader);
+    epoch_arena_free(epochs);
+
+#ifdef ARENA_REGION_CACHE
+    // A thread's magazine goes back to the depot when it exits, even if the
+    // thread only ever took regions
+    pthread_t cache_thread;
+    void* taken = NULL;
+    pthread_create(&cache_thread, NULL, fill_region_cache, NULL);
+    pthread_join(cache_thread, NULL);
+    size_t depot_before = arena_region_cache_bytes();
+    pthread_create(&cache_thread, NULL, take_from_region_cache, NULL);
+    pthread_join(cache_thread, &taken);
+    size_t depot_after = arena_region_cache_bytes();
+    printf("Region cache after a taking thread exits: %s one region\n",
+        depot_after == depot_before - arena_region_bytes(((Arena*)taken)->start) ? "down" : "not down");
+    arena_free((Arena*)taken);
+#endif
+
+#ifdef ARENA_PAGE_MAP
+    // Ownership: the page map finds the region of any pointer
+    Arena* mine = create_arena(512);
+    Arena* theirs = create_arena(512);
+    void* first = arena_allocate(mine, 16);
+    void* later = NULL;
+    for (int i = 0; i < 50; i++) {
+        later = arena_allocate(mine, 100);
+        arena_allocate(theirs, 100);
+    }
+    int local = 0;
+    printf("arena_owns: first %s, later %s, other arena's %s, stack %s\n",
+        arena_owns(mine, first) ? "yes" : "no", arena_owns(mine, later) ? "yes" : "no",
+        arena_owns(mine, theirs->end->data) ? "yes" : "no", arena_region_of(&local) ? "found" : "none");
+    arena_free(mine);
+    arena_free(theirs);
+#endif
+
     arena_free(arena);
     printf("Arena freed.\n");
 
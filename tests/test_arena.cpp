@@ -4,6 +4,20 @@
 
 #include <iostream>
 
+struct Node {
+    int value;
+    ArenaRelPtr<Node> next;
+};
+
+struct CheckedPolicy : ArenaDefaultPolicy {
+    static constexpr uint32_t alignment = 64;
+    static constexpr ArenaGrowth growth = ARENA_GROWTH_DOUBLE;
+    typedef ArenaSpinLock Lock;
+    typedef ArenaCountStats Stats;
+    typedef ArenaAbortChecks Checks;
+    typedef ArenaMmapBacking Backing;
+};
+
 struct TestStruct {
     int x;
     float y;
@@ -36,12 +50,168 @@ int main()
         std::cout << "Failed to allocate TestStruct" << std::endl;
     }
 
+    {
+        ArenaHashMap<int, int> map(arena.get());
+        for (int i = 0; i < 100; i++) {
+            map[i] = i * i;
+        }
+        map.erase(3);
+        int* nine = map.find(9);
+        std::cout << "ArenaHashMap size: " << map.size() << ", map[9] = " << (nine ? *nine : -1)
+                  << ", has 3: " << (map.find(3) ? "yes" : "no") << std::endl;
+
+        bool too_big = false;
+        try {
+            ArenaAllocator<uint64_t>(arena.get()).allocate((size_t)1 << 30);
+        } catch (const std::bad_alloc&) {
+            too_big = true;
+        }
+        std::cout << "ArenaAllocator rejects an 8 GB request: " << (too_big ? "yes" : "no") << std::endl;
+
+        ArenaChunkList<int> list(arena.get(), 4);
+        bool empty_walk = list.begin() == list.end();
+        int* first = list.push_back(7);
+        for (int i = 1; i < 50; i++) {
+            list.push_back(i);
+        }
+        int sum = 0;
+        for (int v : list) {
+            sum += v;
+        }
+        std::cout << "ArenaChunkList size: " << list.size() << ", chunks: " << list.chunk_count()
+                  << ", sum: " << sum << " (expected 1232), first still " << *first << ", list[49] = " << list[49]
+                  << ", empty list begin == end: " << (empty_walk ? "yes" : "no") << std::endl;
+    }
+
     arena.print();
 
     arena.reset();
     std::cout << "Arena reset.\n";
     arena.print();
 
+    Arena* image = create_arena(1 KB);
+    arena_set_growth(image, ARENA_GROWTH_NONE);
+    Node* head = nullptr;
+    for (int i = 3; i > 0; i--) {
+        Node* node = (Node*)arena_allocate(image, sizeof(Node));
+        node->value = i;
+        node->next = head;
+        head = node;
+    }
+    arena_write_image(image, head, "/tmp/stam_test_image.bin");
+    int source_sum = 0;
+    for (Node* node = head; node; node = node->next.get()) {
+        source_sum += node->value;
+    }
+    std::cout << "Source arena after writing the image: sum " << source_sum << " (expected 6)" << std::endl;
+    arena_free(image);
+
+    void* root = nullptr;
+    Arena* mapped = arena_map_image("/tmp/stam_test_image.bin", &root);
+    std::cout << "Mapped image list:";
+    for (Node* node = (Node*)root; node; node = node->next.get()) {
+        std::cout << " " << node->value;
+    }
+    std::cout << " (expected 1 2 3)" << std::endl;
+    for (int i = 0; i < 100; i++) {
+        arena_allocate(mapped, sizeof(Node));
+    }
+    std::cout << "Mapped image grows by regions as big as the written one: "
+              << (mapped->last->capacity == 1 KB / sizeof(uintptr_t) ? "yes" : "no") << std::endl;
+    arena_free(mapped);
+
+    // A region header claiming more data than the file holds is refused
+    FILE* damaged = fopen("/tmp/stam_test_image.bin", "r+b");
+    Region damaged_region;
+    fseek(damaged, ARENA_IMAGE_DATA_OFFSET, SEEK_SET);
+    fread(&damaged_region, sizeof(damaged_region), 1, damaged);
+    damaged_region.data_count = 1 << 20;
+    damaged_region.capacity = 1 << 20;
+    fseek(damaged, ARENA_IMAGE_DATA_OFFSET, SEEK_SET);
+    fwrite(&damaged_region, sizeof(damaged_region), 1, damaged);
+    fclose(damaged);
+    std::cout << "Damaged image refused: " << (arena_map_image("/tmp/stam_test_image.bin", &root) ? "no" : "yes")
+              << std::endl;
+    remove("/tmp/stam_test_image.bin");
+
+    BasicArena<CheckedPolicy> checked(1 KB);
+    bool aligned = true;
+    for (int i = 0; i < 100; i++) {
+        TestStruct* t = checked.allocate<TestStruct>(i, 0.5f);
+        aligned = aligned && ((uintptr_t)t % 64) == 0 && t->x == i;
+    }
+    checked.reset();
+    std::cout << "BasicArena<CheckedPolicy> aligned: " << (aligned ? "yes" : "no")
+              << ", allocations: " << checked.get_stats().allocations
+              << ", resets: " << checked.get_stats().resets << std::endl;
+
+    InlineArena<512> inline_arena;
+    int* inline_int = inline_arena.allocate<int>(42);
+    Arena* inline_raw = inline_arena.get();
+    std::cout << "InlineArena: value " << *inline_int << ", in object "
+              << ((char*)inline_int > (char*)&inline_arena && (char*)inline_int < (char*)(&inline_arena + 1) ? "yes" : "no")
+              << ", regions before spill " << (inline_raw->start->next ? 2 : 1);
+    inline_arena.allocate_bytes(1 KB);
+    std::cout << ", after " << (inline_raw->start->next ? 2 : 1) << std::endl;
+
+    auto parts = arena.allocate_many<int, double, TestStruct>();
+    *std::get<0>(parts) = 1;
+    *std::get<1>(parts) = 2.0;
+    new (std::get<2>(parts)) TestStruct(3, 4.0f);
+    std::cout << "allocate_many: " << *std::get<0>(parts) << " " << *std::get<1>(parts) << " "
+              << std::get<2>(parts)->x << ", double aligned "
+              << ((uintptr_t)std::get<1>(parts) % alignof(double) == 0 ? "yes" : "no") << std::endl;
+
+    {
+        ArenaSoA<float, int, char> table(arena.get());
+        for (int i = 0; i < 100; i++) {
+            table.push_back(i * 0.5f, i, (char)('a' + i % 26));
+        }
+        float fsum = 0;
+        for (float f : table.column<0>()) {
+            fsum += f;
+        }
+        ArenaSpan<int> ints = table.column<1>();
+        std::cout << "ArenaSoA rows: " << table.size() << ", float sum " << fsum << " (expected 2475)"
+                  << ", ints[99] = " << ints[99] << ", chars[27] = " << table.column<2>()[27]
+                  << ", columns aligned " << ((uintptr_t)ints.data % ARENA_SOA_ALIGN == 0 ? "yes" : "no") << std::endl;
+    }
+
+    {
+        struct ListNode {
+            ArenaPtr32<ListNode> next;
+            uint32_t value;
+        };
+        // 1 MB reserved, 1 KB regions: the list spans many regions and then runs out
+        Arena* reserved = create_reserved_arena(1 MB, 1 KB);
+        ArenaPtr32<ListNode> head;
+        int count = 0;
+        while (ListNode* node = (ListNode*)arena_allocate(reserved, sizeof(ListNode))) {
+            node->next = head;
+            node->value = (uint32_t)count++;
+            head.set(reserved, node);
+        }
+        uint64_t sum = 0;
+        int walked = 0;
+        for (ListNode* node = head.get(reserved); node; node = node->next.get(reserved)) {
+            sum += node->value;
+            walked++;
+        }
+        std::cout << "ArenaPtr32: node size " << sizeof(ListNode) << " bytes, " << walked << " of " << count
+                  << " nodes walked, sum " << (sum == (uint64_t)count * (count - 1) / 2 ? "ok" : "wrong") << std::endl;
+        arena_free(reserved);
+    }
+
+    {
+        ArenaCPP owner(1 KB);
+        int* kept;
+        {
+            ArenaCPP worker(1 KB);
+            kept = worker.allocate<int>(42);
+            owner.adopt(worker);
+        }
+        std::cout << "adopt: value after the worker is gone " << *kept << " (expected 42)" << std::endl;
+    }
 
     return 0;
 }
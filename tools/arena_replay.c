@@ -0,0 +1,309 @@
+#define ARENA_IMPLEMENTATION
+#include "../Arena.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Replays a trace recorded with ARENA_TRACE against a matrix of arena
+// configurations and reports throughput, region count and waste for each.
+//
+// Usage: arena_replay <trace file> [region size in bytes...]
+
+// Arenas traced without a size are replayed with regions this big.
+#define REPLAY_FALLBACK_REGION_SIZE (64 KB)
+
+typedef struct ReplayConfig {
+    uint32_t region_size; // 0 replays the size each arena was created with
+    ArenaGrowth growth;
+    uint32_t alignment;
+} ReplayConfig;
+
+typedef struct ReplaySlot {
+    uint64_t id;
+    Arena* arena;
+    uint64_t requested; // Bytes handed out since the last reset
+} ReplaySlot;
+
+typedef struct ReplayMap {
+    ReplaySlot* slots;
+    size_t capacity;
+} ReplayMap;
+
+typedef struct ReplayStats {
+    double seconds;
+    uint64_t allocations;
+    uint64_t regions;
+    uint64_t peak_regions;
+    uint64_t capacity;
+    uint64_t requested;
+} ReplayStats;
+
+typedef struct ReplayOrder {
+    ArenaTraceEvent event;
+    size_t index; // Position in the file, breaks timestamp ties
+} ReplayOrder;
+
+static int compare_events(const void* a, const void* b)
+{
+    const ReplayOrder* x = (const ReplayOrder*)a;
+    const ReplayOrder* y = (const ReplayOrder*)b;
+    if (x->event.timestamp_ns != y->event.timestamp_ns) {
+        return x->event.timestamp_ns > y->event.timestamp_ns ? 1 : -1;
+    }
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+static ArenaTraceEvent* load_trace(const char* path, size_t* count)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        printf("Failed to open trace: %s\n", path);
+        return NULL;
+    }
+
+    ArenaTraceHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1
+        || memcmp(header.magic, ARENA_TRACE_MAGIC, sizeof(ARENA_TRACE_MAGIC)) != 0
+        || header.version != ARENA_TRACE_VERSION
+        || header.event_size != sizeof(ArenaTraceEvent)) {
+        printf("Not a version %d arena trace: %s\n", ARENA_TRACE_VERSION, path);
+        fclose(file);
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long bytes = ftell(file) - (long)sizeof(header);
+    fseek(file, sizeof(header), SEEK_SET);
+
+    *count = (size_t)bytes / sizeof(ArenaTraceEvent);
+    ArenaTraceEvent* events = (ArenaTraceEvent*)malloc(*count * sizeof(ArenaTraceEvent) + 1);
+    if (!events || fread(events, sizeof(ArenaTraceEvent), *count, file) != *count) {
+        printf("Failed to read %zu trace events\n", *count);
+        free(events);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+
+    // Threads flush in batches, so restore global order before replaying.
+    // qsort is not stable, equal timestamps keep their order in the file so a
+    // thread's FREE never moves ahead of its own CREATE or ALLOC.
+    ReplayOrder* order = (ReplayOrder*)malloc(*count * sizeof(ReplayOrder) + 1);
+    if (!order) {
+        printf("Failed to sort %zu trace events\n", *count);
+        free(events);
+        return NULL;
+    }
+    for (size_t i = 0; i < *count; i++) {
+        order[i].event = events[i];
+        order[i].index = i;
+    }
+    qsort(order, *count, sizeof(ReplayOrder), compare_events);
+    for (size_t i = 0; i < *count; i++) {
+        events[i] = order[i].event;
+    }
+    free(order);
+    return events;
+}
+
+static ReplaySlot* map_find(ReplayMap* map, uint64_t id)
+{
+    size_t i = (size_t)((id >> 4) * 0x9E3779B97F4A7C15ull) & (map->capacity - 1);
+    while (map->slots[i].arena && map->slots[i].id != id) {
+        i = (i + 1) & (map->capacity - 1);
+    }
+    return &map->slots[i];
+}
+
+static void map_remove(ReplayMap* map, ReplaySlot* slot)
+{
+    // Backward-shift deletion keeps linear probe chains intact.
+    size_t i = (size_t)(slot - map->slots);
+    size_t mask = map->capacity - 1;
+    slot->arena = NULL;
+    for (size_t j = (i + 1) & mask; map->slots[j].arena; j = (j + 1) & mask) {
+        size_t home = (size_t)((map->slots[j].id >> 4) * 0x9E3779B97F4A7C15ull) & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            map->slots[i] = map->slots[j];
+            map->slots[j].arena = NULL;
+            i = j;
+        }
+    }
+}
+
+static void collect(ReplayStats* stats, ReplaySlot* slot)
+{
+    uint64_t regions = 0;
+    for (Region* curr = slot->arena->start; curr; curr = curr->next) {
+        stats->capacity += curr->capacity * sizeof(uintptr_t);
+        regions += 1;
+    }
+    if (regions > stats->peak_regions) {
+        stats->peak_regions = regions;
+    }
+    stats->requested += slot->requested;
+    slot->requested = 0;
+}
+
+// Runs the trace once. Stats are only gathered when stats is non-NULL so the
+// timed pass measures nothing but the allocator.
+static void replay(const ArenaTraceEvent* events, size_t count, ReplayConfig config, ReplayMap* map, ReplayStats* stats)
+{
+    memset(map->slots, 0, map->capacity * sizeof(ReplaySlot));
+
+    for (size_t i = 0; i < count; i++) {
+        const ArenaTraceEvent* ev = &events[i];
+        ReplaySlot* slot = map_find(map, ev->arena_id);
+
+        switch (ev->kind) {
+        case ARENA_TRACE_CREATE: {
+            if (slot->arena) {
+                arena_free(slot->arena);
+            }
+            slot->id = ev->arena_id;
+            uint32_t size = config.region_size ? config.region_size : ev->size;
+            slot->arena = create_arena(size ? size : REPLAY_FALLBACK_REGION_SIZE);
+            slot->requested = 0;
+            arena_set_growth(slot->arena, config.growth);
+            break;
+        }
+        case ARENA_TRACE_ALLOC: {
+            if (!slot->arena) {
+                break;
+            }
+            uint32_t align = config.alignment > ev->alignment ? config.alignment : ev->alignment;
+            arena_allocate_aligned(slot->arena, ev->size, align);
+            slot->requested += ev->size;
+            if (stats) {
+                stats->allocations += 1;
+            }
+            break;
+        }
+        case ARENA_TRACE_RESET:
+            if (!slot->arena) {
+                break;
+            }
+            if (stats) {
+                collect(stats, slot);
+            }
+            arena_reset(slot->arena);
+            break;
+        case ARENA_TRACE_FREE:
+            if (!slot->arena) {
+                break;
+            }
+            if (stats) {
+                collect(stats, slot);
+                for (Region* curr = slot->arena->start; curr; curr = curr->next) {
+                    stats->regions += 1;
+                }
+            }
+            arena_free(slot->arena);
+            map_remove(map, slot);
+            break;
+        }
+    }
+
+    // Arenas still alive when the trace ended.
+    for (size_t i = 0; i < map->capacity; i++) {
+        if (!map->slots[i].arena) {
+            continue;
+        }
+        if (stats) {
+            collect(stats, &map->slots[i]);
+            for (Region* curr = map->slots[i].arena->start; curr; curr = curr->next) {
+                stats->regions += 1;
+            }
+        }
+        arena_free(map->slots[i].arena);
+        map->slots[i].arena = NULL;
+    }
+}
+
+static void run(const ArenaTraceEvent* events, size_t count, ReplayConfig config, ReplayMap* map)
+{
+    ReplayStats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    clock_t start = clock();
+    replay(events, count, config, map, NULL);
+    stats.seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    replay(events, count, config, map, &stats);
+
+    double waste = stats.capacity ? 100.0 * (double)(stats.capacity - stats.requested) / (double)stats.capacity : 0.0;
+    double rate = stats.seconds > 0 ? (double)stats.allocations / stats.seconds : 0.0;
+
+    char region[32];
+    if (config.region_size) {
+        snprintf(region, sizeof(region), "%" PRIu32, config.region_size);
+    } else {
+        snprintf(region, sizeof(region), "recorded");
+    }
+
+    printf("%12s %8s %6" PRIu32 " | %14.0f %10" PRIu64 " %8" PRIu64 " %8.2f%%\n",
+        region, config.growth == ARENA_GROWTH_DOUBLE ? "double" : "fixed", config.alignment,
+        rate, stats.regions, stats.peak_regions, waste);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        printf("Usage: %s <trace file> [region size in bytes...]\n", argv[0]);
+        return 1;
+    }
+
+    size_t count = 0;
+    ArenaTraceEvent* events = load_trace(argv[1], &count);
+    if (!events) {
+        return 1;
+    }
+
+    uint64_t arenas = 0;
+    for (size_t i = 0; i < count; i++) {
+        arenas += events[i].kind == ARENA_TRACE_CREATE;
+    }
+    printf("Replaying %zu events over %" PRIu64 " arenas from %s\n\n", count, arenas, argv[1]);
+
+    ReplayMap map;
+    map.capacity = 64;
+    while (map.capacity < arenas * 2) {
+        map.capacity *= 2;
+    }
+    map.slots = (ReplaySlot*)malloc(map.capacity * sizeof(ReplaySlot));
+
+    uint32_t default_sizes[] = { 0, 4 KB, 64 KB, 1 MB, 16 MB };
+    uint32_t* sizes = default_sizes;
+    int num_sizes = sizeof(default_sizes) / sizeof(default_sizes[0]);
+    if (argc > 2) {
+        num_sizes = argc - 2;
+        sizes = (uint32_t*)malloc(num_sizes * sizeof(uint32_t));
+        for (int i = 0; i < num_sizes; i++) {
+            sizes[i] = (uint32_t)strtoul(argv[i + 2], NULL, 10);
+        }
+    }
+
+    ArenaGrowth growths[] = { ARENA_GROWTH_FIXED, ARENA_GROWTH_DOUBLE };
+    uint32_t alignments[] = { sizeof(uintptr_t), 16, 64 };
+
+    printf("%12s %8s %6s | %14s %10s %8s %9s\n", "region", "growth", "align", "allocs/sec", "regions", "peak", "waste");
+    for (int s = 0; s < num_sizes; s++) {
+        for (int g = 0; g < 2; g++) {
+            for (int a = 0; a < 3; a++) {
+                ReplayConfig config = { sizes[s], growths[g], alignments[a] };
+                run(events, count, config, &map);
+            }
+        }
+    }
+
+    if (sizes != default_sizes) {
+        free(sizes);
+    }
+    free(map.slots);
+    free(events);
+    return 0;
+}